@@ -0,0 +1,128 @@
+/*
+	Marching Squares - Active Square Set
+	Records each active square at most once per frame.
+*/
+
+#include "activeSquareSet.h"
+
+//////////////////////////
+// class: ActiveSquareSet
+//////////////////////
+
+ActiveSquareSet::ActiveSquareSet() {
+	generation = 1;
+	duplicates = 0;
+}
+
+// Sizes the stamps for a grid, forgetting every recorded square. Storage
+// shrinks too, so sparse grids can drop the stamps altogether.
+void ActiveSquareSet::resize(size_t squareCount) {
+	std::vector<unsigned int>(squareCount, 0).swap(stamps);
+	squares.clear();
+	std::vector<int>().swap(positions);
+	generation = 1;
+	duplicates = 0;
+}
+
+// Returns false, and counts a duplicate, if the square is already recorded this frame
+bool ActiveSquareSet::insert(int square) {
+	if (stamps[square] == generation) {
+		duplicates++;
+		return false;
+	}
+
+	stamps[square] = generation;
+	squares.push_back(square);
+
+	if (!positions.empty()) {
+		positions[square] = (int)squares.size() - 1;
+	}
+
+	return true;
+}
+
+// Stamps the square without recording it, safe from any thread that owns the square
+bool ActiveSquareSet::mark(int square) {
+	if (stamps[square] == generation) {
+		return false;
+	}
+
+	stamps[square] = generation;
+
+	return true;
+}
+
+// Removes a recorded square by moving the last one into its place, so order is not kept
+bool ActiveSquareSet::erase(int square) {
+	if (stamps[square] != generation) {
+		return false;
+	}
+
+	if (positions.empty()) {
+		positions.assign(stamps.size(), 0);
+
+		for (unsigned int i = 0; i < squares.size(); i++) {
+			positions[squares[i]] = (int)i;
+		}
+	}
+
+	int at = positions[square];
+	int last = squares.back();
+
+	squares[at] = last;
+	positions[last] = at;
+	squares.pop_back();
+
+	// Any stamp but the current generation reads as absent
+	stamps[square] = generation - 1;
+
+	return true;
+}
+
+// Records squares already stamped by mark, along with the duplicates seen marking them
+void ActiveSquareSet::append(const std::vector<int> &marked, size_t markedDuplicates) {
+	if (!positions.empty()) {
+		for (unsigned int i = 0; i < marked.size(); i++) {
+			positions[marked[i]] = (int)(squares.size() + i);
+		}
+	}
+
+	squares.insert(squares.end(), marked.begin(), marked.end());
+	duplicates += markedDuplicates;
+}
+
+bool ActiveSquareSet::contains(int square) {
+	return stamps[square] == generation;
+}
+
+void ActiveSquareSet::clear() {
+	squares.clear();
+	duplicates = 0;
+	generation++;
+
+	// Restamping everything once the counter wraps so stale stamps can't match
+	if (generation == 0) {
+		stamps.assign(stamps.size(), 0);
+		generation = 1;
+	}
+}
+
+bool ActiveSquareSet::empty() {
+	return squares.empty();
+}
+
+size_t ActiveSquareSet::size() {
+	return squares.size();
+}
+
+size_t ActiveSquareSet::getDuplicates() {
+	return duplicates;
+}
+
+size_t ActiveSquareSet::getBytes() {
+	return stamps.capacity() * sizeof(unsigned int) + (squares.capacity() + positions.capacity()) * sizeof(int);
+}
+
+const std::vector<int>& ActiveSquareSet::getSquares() {
+	return squares;
+}
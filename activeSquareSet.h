@@ -0,0 +1,43 @@
+/*
+	Marching Squares - Active Square Set
+	Records each active square at most once per frame.
+*/
+
+#ifndef ACTIVE_SQUARE_SET_H
+#define ACTIVE_SQUARE_SET_H
+
+#include <stddef.h>
+#include <vector>
+
+// Squares are stamped with the generation they were last inserted in, so
+// membership is one compare and clearing between frames is a counter bump.
+// The compact list keeps insertion order and its storage across frames.
+// Tiles classified in parallel mark the squares they own and append their
+// lists afterwards, one tile at a time. Squares can also be erased in place
+// for sets kept across frames, which costs a position per square once used.
+class ActiveSquareSet {
+	private:
+		std::vector<unsigned int> stamps;
+		std::vector<int> squares;
+		// Where each square sits in squares, only kept once erase has been used
+		std::vector<int> positions;
+		unsigned int generation;
+		size_t duplicates;
+
+	public:
+		ActiveSquareSet();
+		void resize(size_t squareCount);
+		bool insert(int square);
+		bool mark(int square);
+		void append(const std::vector<int> &marked, size_t markedDuplicates);
+		bool erase(int square);
+		bool contains(int square);
+		void clear();
+		bool empty();
+		size_t size();
+		size_t getDuplicates();
+		size_t getBytes();
+		const std::vector<int>& getSquares();
+};
+
+#endif
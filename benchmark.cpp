@@ -0,0 +1,363 @@
+/*
+	Marching Squares - Benchmark
+	Times the per-frame hot path piece by piece over a sweep of grid sizes,
+	ball counts and radii. Runs are seeded so results can be compared.
+
+	Usage: benchmark [--grid N] [--width W] [--balls N] [--radius N] [--frames N] [--seed N] [--budget N] [--memory-mb N] [--mode corners|occupancy|metaball] [--kernel scalar|sse2|avx2] [--threads N] [--incremental] [--moving N] [--sparse] [--adaptive] [--collide]
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#include "marchingSquaresEngine.h"
+#include "meshBuilder.h"
+
+/////////////////////////
+// Default Settings
+/////////////////////
+
+const unsigned int DEFAULT_SEED = 116;
+const int DEFAULT_FRAMES = 5;
+// Corner or vertex tests per frame above which a configuration is skipped
+const double DEFAULT_BUDGET = 2.0e8;
+const double DEFAULT_MEMORY_MB = 2048.0;
+const int CONTAINS_POINTS = 1 << 20;
+const int LOOKUPS_PER_CONFIG = 1 << 18;
+const int BATCH_LOOKUPS = 1 << 20;
+
+typedef std::chrono::steady_clock Clock;
+
+typedef struct BenchResult {
+	double findSquareNs;
+	double locateBatchNs;
+	double moveMs;
+	double classifyMs;
+	double emitMs;
+	double instanceMs;
+	// Batched vertex bytes over instance record bytes
+	double uploadRatio;
+	double indexedMs;
+	// Batched vertex bytes over welded vertex and index bytes
+	double weldRatio;
+	// Squares reported changed, only counted in incremental mode
+	double deltas;
+	// Grid storage after the last frame, which for a sparse grid follows the balls
+	double gridMb;
+	double activeEntries;
+	double duplicates;
+	double emittedVerts;
+} BenchResult;
+
+double secondsSince(const Clock::time_point &start);
+double benchContains(float radius, unsigned int seed, double &checksum);
+BenchResult benchConfig(int gridSize, float squareWidth, int numBalls, int radius, int frames, unsigned int seed,
+	ClassificationMode mode, KernelLevel kernelLevel, unsigned int threads, bool incremental, bool sparse, bool adaptive, bool collide, int moving, double &checksum);
+void printUsage(const char *program);
+
+///////////
+// main()
+///////
+
+int main(int argc, char *argv[]) {
+	std::vector<int> gridSizes { 101, 1024, 4096, 8192 };
+	std::vector<int> ballCounts { 8, 1000, 10000, 100000 };
+	std::vector<int> radii { 2, 8, 32 };
+	float squareWidth = SQUARE_WIDTH;
+	int frames = DEFAULT_FRAMES;
+	unsigned int seed = DEFAULT_SEED;
+	double budget = DEFAULT_BUDGET;
+	double memoryMb = DEFAULT_MEMORY_MB;
+	double checksum = 0.0;
+	ClassificationMode mode = CORNER_TESTS;
+	KernelLevel kernelLevel = KERNEL_AVX2;
+	// One classifies serially, zero uses every core
+	unsigned int threads = 1;
+	bool incremental = false;
+	bool sparse = false;
+	bool adaptive = false;
+	bool collide = false;
+	// Balls left moving, the rest stay put, negative moves them all
+	int moving = -1;
+	const char *modeName = "corners";
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+			gridSizes = { atoi(argv[++i]) };
+		} else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+			squareWidth = (float)atof(argv[++i]);
+		} else if (strcmp(argv[i], "--balls") == 0 && i + 1 < argc) {
+			ballCounts = { atoi(argv[++i]) };
+		} else if (strcmp(argv[i], "--radius") == 0 && i + 1 < argc) {
+			radii = { atoi(argv[++i]) };
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frames = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			seed = static_cast<unsigned int>(strtoul(argv[++i], NULL, 10));
+		} else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+			budget = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--memory-mb") == 0 && i + 1 < argc) {
+			memoryMb = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = static_cast<unsigned int>(strtoul(argv[++i], NULL, 10));
+		} else if (strcmp(argv[i], "--incremental") == 0) {
+			incremental = true;
+		} else if (strcmp(argv[i], "--sparse") == 0) {
+			sparse = true;
+		} else if (strcmp(argv[i], "--adaptive") == 0) {
+			adaptive = true;
+		} else if (strcmp(argv[i], "--collide") == 0) {
+			collide = true;
+		} else if (strcmp(argv[i], "--moving") == 0 && i + 1 < argc) {
+			moving = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+			if (!parseKernelLevel(argv[++i], kernelLevel)) {
+				printUsage(argv[0]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+			modeName = argv[++i];
+			if (!parseClassificationMode(modeName, mode)) {
+				printUsage(argv[0]);
+				return 1;
+			}
+		} else {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (frames <= 0 || !(squareWidth > 0.0f)) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	for (unsigned int g = 0; g < gridSizes.size(); g++) {
+		if (gridSizes[g] < 2 || gridSizes[g] > MAX_GRID_SIDE) {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	printf("seed: %u, frames per config: %d, square width: %g, mode: %s, kernels: %s, threads: %u, incremental: %s, sparse: %s, adaptive: %s, collisions: %s\n\n",
+		seed, frames, squareWidth, modeName, getClassifyKernels(kernelLevel).name, threads, incremental ? "yes" : "no",
+		sparse ? "yes" : "no", adaptive ? "yes" : "no", collide ? "yes" : "no");
+
+	// Ball::contains depends only on the radius
+	printf("%8s %14s\n", "radius", "contains(ns)");
+	for (unsigned int r = 0; r < radii.size(); r++) {
+		printf("%8d %14.2f\n", radii[r], benchContains((float)radii[r], seed, checksum));
+	}
+
+	printf("\n%8s %8s %8s %16s %12s %10s %14s %12s %12s %10s %12s %10s %10s %10s %12s %12s %12s\n",
+		"grid", "balls", "radius", "findSquare(ns)", "batch(ns)", "move(ms)", "classify(ms)", "emit(ms)", "inst(ms)", "upload(x)",
+		"indexed(ms)", "weld(x)", "deltas", "grid(MB)", "active", "duplicates", "verts");
+
+	for (unsigned int g = 0; g < gridSizes.size(); g++) {
+		for (unsigned int b = 0; b < ballCounts.size(); b++) {
+			for (unsigned int r = 0; r < radii.size(); r++) {
+				int gridSize = gridSizes[g];
+				int numBalls = ballCounts[b];
+				int radius = radii[r];
+
+				// resolveSquareStates scans a radius and one square either side of the epicenter,
+				// the field modes visit each vertex within reach of a ball once
+				double window = 2.0 * (ceil(radius / squareWidth) + 1.0) + 1.0;
+				double cornerTests = 4.0 * window * window * numBalls;
+				if (mode == METABALL_FIELD) {
+					window = 2.0 * radius * METABALL_REACH / squareWidth + 1.0;
+					cornerTests = window * window * numBalls;
+				} else if (mode == OCCUPANCY_FIELD) {
+					window = 2.0 * radius / squareWidth + 1.0;
+					cornerTests = window * window * numBalls;
+				} else if (adaptive) {
+					// Only leaf blocks along the ball's edge test their corners
+					cornerTests = 4.0 * 4.0 * ADAPTIVE_LEAF_SIZE * window * numBalls;
+				}
+				double gridMb = MarchingSquaresEngine::estimateGridBytes(gridSize, gridSize, mode, sparse) / (1024.0 * 1024.0);
+
+				if (cornerTests > budget) {
+					printf("%8d %8d %8d   skipped: %.2g tests per frame exceeds budget\n",
+						gridSize, numBalls, radius, cornerTests);
+					continue;
+				} else if (gridMb > memoryMb) {
+					printf("%8d %8d %8d   skipped: grid needs %.0f MB\n", gridSize, numBalls, radius, gridMb);
+					continue;
+				}
+
+				BenchResult result = benchConfig(gridSize, squareWidth, numBalls, radius, frames, seed, mode, kernelLevel, threads,
+					incremental, sparse, adaptive, collide, moving, checksum);
+
+				printf("%8d %8d %8d %16.2f %12.2f %10.3f %14.3f %12.3f %12.3f %10.1f %12.3f %10.1f %10.0f %10.1f %12.0f %12.0f %12.0f\n",
+					gridSize, numBalls, radius, result.findSquareNs, result.locateBatchNs, result.moveMs, result.classifyMs,
+					result.emitMs, result.instanceMs, result.uploadRatio, result.indexedMs, result.weldRatio,
+					result.deltas, result.gridMb, result.activeEntries, result.duplicates, result.emittedVerts);
+			}
+		}
+	}
+
+	// Printing the checksum keeps the timed work from being optimized away
+	printf("\nchecksum: %g\n", checksum);
+
+	return 0;
+}
+
+double secondsSince(const Clock::time_point &start) {
+	std::chrono::duration<double> elapsed = Clock::now() - start;
+	return elapsed.count();
+}
+
+// Times Ball::contains over a lattice of points covering the ball's bounding box
+double benchContains(float radius, unsigned int seed, double &checksum) {
+	Ball ball(radius, 0.0f, vec3{ 0.5f, 0.25f, -1.0f });
+	std::vector<vec3> points;
+	int side = 1024;
+	int hits = 0;
+
+	srand(seed);
+	points.reserve(CONTAINS_POINTS);
+	for (int i = 0; i < CONTAINS_POINTS; i++) {
+		// Integer lattice points exercise the axis aligned branches too
+		float x = (float)(i % side) / side * 4.0f * radius - 2.0f * radius;
+		float y = (float)(rand() % (int)(4.0f * radius + 1.0f)) - 2.0f * radius;
+		points.push_back(vec3{ x, y, -1.0f });
+	}
+
+	Clock::time_point start = Clock::now();
+
+	for (unsigned int i = 0; i < points.size(); i++) {
+		if (ball.contains(points[i])) {
+			hits++;
+		}
+	}
+
+	double seconds = secondsSince(start);
+	checksum += hits;
+
+	return seconds * 1.0e9 / points.size();
+}
+
+BenchResult benchConfig(int gridSize, float squareWidth, int numBalls, int radius, int frames, unsigned int seed,
+	ClassificationMode mode, KernelLevel kernelLevel, unsigned int threads, bool incremental, bool sparse, bool adaptive, bool collide, int moving, double &checksum) {
+	BenchResult result = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+	double vertexBytes = 0.0;
+	double instanceBytes = 0.0;
+	double indexedBytes = 0.0;
+	MeshBuilder mesh;
+
+	srand(seed);
+
+	MarchingSquaresEngine engine((gridSize - 1) * squareWidth / 2.0f, squareWidth);
+	engine.setClassificationMode(mode);
+	engine.setKernelLevel(kernelLevel);
+	engine.setThreadCount(threads);
+	engine.setIncremental(incremental);
+	engine.setSparseGrid(sparse);
+	engine.setAdaptive(adaptive);
+	engine.setCollisions(collide);
+	engine.populateGrid();
+	engine.generateShapes(numBalls, radius, radius);
+
+	BallStore &balls = engine.getBalls();
+
+	for (int i = moving < 0 ? numBalls : moving; i < numBalls; i++) {
+		balls.setSpeed(i, 0.0f);
+	}
+
+	// Point location of every ball epicenter
+	int lookups = 0;
+	Clock::time_point start = Clock::now();
+
+	while (lookups < LOOKUPS_PER_CONFIG) {
+		for (unsigned int i = 0; i < balls.size(); i++) {
+			checksum += engine.findSquare(balls.getPosition(i));
+		}
+		lookups += balls.size();
+	}
+
+	result.findSquareNs = secondsSince(start) * 1.0e9 / lookups;
+
+	// Batched point location over points scattered past the grid edges
+	std::vector<float> xs(BATCH_LOOKUPS);
+	std::vector<float> ys(BATCH_LOOKUPS);
+	std::vector<int> squares(BATCH_LOOKUPS);
+	float span = 2.5f * engine.getDimension();
+
+	for (int i = 0; i < BATCH_LOOKUPS; i++) {
+		xs[i] = ((float)rand() / RAND_MAX - 0.5f) * span;
+		ys[i] = ((float)rand() / RAND_MAX - 0.5f) * span;
+	}
+
+	start = Clock::now();
+	engine.locateSquares(xs.data(), ys.data(), squares.data(), squares.size());
+	result.locateBatchNs = secondsSince(start) * 1.0e9 / BATCH_LOOKUPS;
+	checksum += squares[BATCH_LOOKUPS / 2];
+
+	// The first incremental frame classifies everything, so it stays out of the timing
+	if (incremental) {
+		engine.classify();
+	}
+
+	for (int frame = 0; frame < frames; frame++) {
+		// One vector pass over every ball's position and the walls
+		start = Clock::now();
+		engine.moveBalls();
+		result.moveMs += secondsSince(start) * 1000.0;
+
+		// resolveSquareStates and activateSquare for every ball, or the field passes
+		start = Clock::now();
+		engine.classify();
+		result.classifyMs += secondsSince(start) * 1000.0;
+
+		result.deltas += engine.getDeltas().size();
+		result.activeEntries += engine.getActiveSquares().size();
+		result.duplicates += engine.getActiveSquares().getDuplicates();
+
+		// Building the viewer's batched triangle array from the active set
+		start = Clock::now();
+		mesh.clear();
+		mesh.addSquares(engine);
+		result.emitMs += secondsSince(start) * 1000.0;
+
+		const std::vector<MeshVertex> &triangles = mesh.getTriangles();
+		result.emittedVerts += triangles.size();
+		checksum += triangles.empty() ? 0.0 : triangles.back().x;
+		vertexBytes += triangles.size() * sizeof(MeshVertex);
+
+		// Grouping the same squares into per-case instance records
+		start = Clock::now();
+		mesh.addInstances(engine);
+		result.instanceMs += secondsSince(start) * 1000.0;
+
+		instanceBytes += mesh.getInstances().size() * sizeof(SquareInstance);
+
+		// Welding shared corner and edge points into an indexed mesh
+		start = Clock::now();
+		mesh.addIndexedSquares(engine);
+		result.indexedMs += secondsSince(start) * 1000.0;
+
+		indexedBytes += mesh.getWeldedVertices().size() * sizeof(MeshVertex) + mesh.getIndices().size() * sizeof(unsigned int);
+	}
+
+	result.moveMs /= frames;
+	result.classifyMs /= frames;
+	result.emitMs /= frames;
+	result.instanceMs /= frames;
+	result.uploadRatio = instanceBytes > 0.0 ? vertexBytes / instanceBytes : 0.0;
+	result.indexedMs /= frames;
+	result.weldRatio = indexedBytes > 0.0 ? vertexBytes / indexedBytes : 0.0;
+	result.deltas /= frames;
+	result.gridMb = engine.getGridBytes() / (1024.0 * 1024.0);
+	result.activeEntries /= frames;
+	result.duplicates /= frames;
+	result.emittedVerts /= frames;
+
+	return result;
+}
+
+void printUsage(const char *program) {
+	fprintf(stderr, "Usage: %s [--grid N] [--width W] [--balls N] [--radius N] [--frames N] [--seed N] [--budget N] [--memory-mb N] [--mode corners|occupancy|metaball] [--kernel scalar|sse2|avx2] [--threads N] [--incremental] [--moving N] [--sparse] [--adaptive] [--collide]\n", program);
+}
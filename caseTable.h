@@ -0,0 +1,187 @@
+/*
+	Marching Squares - Case Table
+	Triangles filling each of the 16 square cases, fixed at compile time
+	along with where each of their vertices sits on the square's boundary.
+*/
+
+#ifndef CASE_TABLE_H
+#define CASE_TABLE_H
+
+// One case per MarchingSquareState
+const int CASE_COUNT = 16;
+// FILLED's six triangles are the most any case has
+const int MAX_CASE_VERTICES = 18;
+
+// A template vertex, spanning one square as -1 to 1 on both axes
+typedef struct CasePoint {
+	float x;
+	float y;
+	float z;
+} CasePoint;
+
+// Where a template point sits on its square's boundary, with edge points at
+// -0.1, 0 and 0.1 along the edge
+typedef enum WeldSite {
+	// Slots 0 to 3: top left, top right, bottom left, bottom right
+	WELD_CORNER,
+	// Slots 0 to 2 run left to right along the horizontal edges
+	WELD_TOP_EDGE,
+	WELD_BOTTOM_EDGE,
+	// Slots 0 to 2 run top to bottom along the vertical edges
+	WELD_LEFT_EDGE,
+	WELD_RIGHT_EDGE,
+	// Never shared
+	WELD_INTERIOR
+} WeldSite;
+
+// Triangle vertices of every case back to back in MarchingSquareState order, EMPTY having none
+constexpr CasePoint CASE_POINTS[] = {
+	// TOP_LEFT
+	{ -0.1f, 1.0f, -1.0f }, { -1.0f, 1.0f, -1.0f }, { -1.0f, 0.1f, -1.0f },
+
+	// BOT_LEFT
+	{ -1.0f, -1.0f, -1.0f }, { -0.1f, -1.0f, -1.0f }, { -1.0f, -0.1f, -1.0f },
+
+	// LEFT
+	{ -1.0f, -1.0f, -1.0f }, { -0.1f, -1.0f, -1.0f }, { -1.0f, 0.0f, -1.0f },
+	{ -0.1f, -1.0f, -1.0f }, { -0.1f, 1.0f, -1.0f }, { -1.0f, 0.0f, -1.0f },
+	{ -1.0f, 0.0f, -1.0f }, { -1.0f, 1.0f, -1.0f }, { -0.1f, 1.0f, -1.0f },
+
+	// BOT_RIGHT
+	{ 0.1f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }, { 1.0f, -0.1f, -1.0f },
+
+	// NEG_DIAG
+	{ 0.1f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }, { 1.0f, -0.1f, -1.0f },
+	{ -0.1f, 1.0f, -1.0f }, { -1.0f, 1.0f, -1.0f }, { -1.0f, 0.1f, -1.0f },
+	{ -1.0f, 0.1f, -1.0f }, { 0.1f, -1.0f, -1.0f }, { 1.0f, -0.1f, -1.0f },
+	{ 1.0f, -0.1f, -1.0f }, { -0.1f, 1.0f, -1.0f }, { -1.0f, 0.1f, -1.0f },
+
+	// BOTTOM
+	{ 0.0f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }, { 1.0f, -0.1f, -1.0f },
+	{ 1.0f, -0.1f, -1.0f }, { -1.0f, -0.1f, -1.0f }, { 0.0f, -1.0f, -1.0f },
+	{ -1.0f, -0.1f, -1.0f }, { -1.0f, -1.0f, -1.0f }, { 0.0f, -1.0f, -1.0f },
+
+	// INV_TOP_RIGHT
+	{ -1.0f, -1.0f, -1.0f }, { -0.1f, -1.0f, -1.0f }, { -1.0f, -0.1f, -1.0f },
+	{ -0.1f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }, { 1.0f, 0.1f, -1.0f },
+	{ -0.1f, -1.0f, -1.0f }, { 1.0f, 0.1f, -1.0f }, { -1.0f, -0.1f, -1.0f },
+	{ -1.0f, -0.1f, -1.0f }, { 1.0f, 0.1f, -1.0f }, { 0.1f, 1.0f, -1.0f },
+	{ 0.1f, 1.0f, -1.0f }, { -1.0f, 1.0f, -1.0f }, { -1.0f, -0.1f, -1.0f },
+
+	// TOP_RIGHT
+	{ 1.0f, 0.1f, -1.0f }, { 1.0f, 1.0f, -1.0f }, { 0.1f, 1.0f, -1.0f },
+
+	// UPPER
+	{ 0.0f, 1.0f, -1.0f }, { -1.0f, 1.0f, -1.0f }, { -1.0f, 0.1f, -1.0f },
+	{ -1.0f, 0.1f, -1.0f }, { 1.0f, 0.1f, -1.0f }, { 0.0f, 1.0f, -1.0f },
+	{ 1.0f, 0.1f, -1.0f }, { 1.0f, 1.0f, -1.0f }, { 0.0f, 1.0f, -1.0f },
+
+	// POS_DIAG
+	{ -1.0f, -1.0f, -1.0f }, { -0.1f, -1.0f, -1.0f }, { -1.0f, -0.1f, -1.0f },
+	{ -0.1f, -1.0f, -1.0f }, { 1.0f, 0.1f, -1.0f }, { -1.0f, -0.1f, -1.0f },
+	{ -1.0f, -0.1f, -1.0f }, { 0.1f, 1.0f, -1.0f }, { 1.0f, 0.1f, -1.0f },
+	{ 1.0f, 0.1f, -1.0f }, { 1.0f, 1.0f, -1.0f }, { 0.1f, 1.0f, -1.0f },
+
+	// INV_BOT_RIGHT
+	{ 1.0f, 1.0f, -1.0f }, { -0.1f, 1.0f, -1.0f }, { 1.0f, -0.1f, -1.0f },
+	{ -0.1f, 1.0f, -1.0f }, { -1.0f, 1.0f, -1.0f }, { -1.0f, 0.1f, -1.0f },
+	{ -1.0f, 0.1f, -1.0f }, { -1.0f, -1.0f, -1.0f }, { 0.1f, -1.0f, -1.0f },
+	{ 0.1f, -1.0f, -1.0f }, { 1.0f, -0.1f, -1.0f }, { -1.0f, 0.1f, -1.0f },
+	{ -1.0f, 0.1f, -1.0f }, { -0.1f, 1.0f, -1.0f }, { 1.0f, -0.1f, -1.0f },
+
+	// RIGHT
+	{ 1.0f, 1.0f, -1.0f }, { 0.1f, 1.0f, -1.0f }, { 1.0f, 0.0f, -1.0f },
+	{ 0.1f, 1.0f, -1.0f }, { 0.1f, -1.0f, -1.0f }, { 1.0f, 0.0f, -1.0f },
+	{ 1.0f, 0.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }, { 0.1f, -1.0f, -1.0f },
+
+	// INV_BOT_LEFT
+	{ 1.0f, 1.0f, -1.0f }, { 0.1f, 1.0f, -1.0f }, { 1.0f, 0.1f, -1.0f },
+	{ 0.1f, 1.0f, -1.0f }, { -1.0f, 1.0f, -1.0f }, { -1.0f, -0.1f, -1.0f },
+	{ 0.1f, 1.0f, -1.0f }, { -1.0f, -0.1f, -1.0f }, { 1.0f, 0.1f, -1.0f },
+	{ 1.0f, 0.1f, -1.0f }, { -1.0f, -0.1f, -1.0f }, { -0.1f, -1.0f, -1.0f },
+	{ -0.1f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }, { 1.0f, 0.1f, -1.0f },
+
+	// INV_TOP_LEFT
+	{ -1.0f, -1.0f, -1.0f }, { 0.1f, -1.0f, -1.0f }, { -1.0f, 0.1f, -1.0f },
+	{ 0.1f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }, { 1.0f, -0.1f, -1.0f },
+	{ 1.0f, -0.1f, -1.0f }, { 1.0f, 1.0f, -1.0f }, { -0.1f, 1.0f, -1.0f },
+	{ -0.1f, 1.0f, -1.0f }, { -1.0f, 0.1f, -1.0f }, { 1.0f, -0.1f, -1.0f },
+	{ 1.0f, -0.1f, -1.0f }, { 0.1f, -1.0f, -1.0f }, { -1.0f, 0.1f, -1.0f },
+
+	// FILLED
+	{ 0.0f, 1.0f, -1.0f }, { -1.0f, 1.0f, -1.0f }, { -1.0f, 0.0f, -1.0f },
+	{ -1.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, -1.0f }, { 0.0f, 1.0f, -1.0f },
+	{ 1.0f, 0.0f, -1.0f }, { 1.0f, 1.0f, -1.0f }, { 0.0f, 1.0f, -1.0f },
+	{ 0.0f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }, { 1.0f, -0.0f, -1.0f },
+	{ 1.0f, -0.0f, -1.0f }, { -1.0f, -0.0f, -1.0f }, { 0.0f, -1.0f, -1.0f },
+	{ -1.0f, -0.0f, -1.0f }, { -1.0f, -1.0f, -1.0f }, { 0.0f, -1.0f, -1.0f }
+};
+
+constexpr int CASE_VERTEX_COUNTS[CASE_COUNT] = { 0, 3, 3, 9, 3, 12, 9, 15, 3, 9, 12, 15, 9, 15, 15, 18 };
+
+const int CASE_POINT_COUNT = sizeof(CASE_POINTS) / sizeof(CasePoint);
+
+// Offsets of each case's first vertex in CASE_POINTS, with the total at the end
+typedef struct CaseOffsets {
+	int first[CASE_COUNT + 1];
+} CaseOffsets;
+
+// Site and slot of every vertex in CASE_POINTS, packed as site * 4 + slot
+typedef struct CaseSites {
+	unsigned char site[CASE_POINT_COUNT];
+} CaseSites;
+
+constexpr CaseOffsets buildCaseOffsets() {
+	CaseOffsets offsets = {};
+
+	for (int c = 0; c < CASE_COUNT; c++) {
+		offsets.first[c + 1] = offsets.first[c] + CASE_VERTEX_COUNTS[c];
+	}
+
+	return offsets;
+}
+
+constexpr CaseOffsets CASE_OFFSETS = buildCaseOffsets();
+
+static_assert(CASE_OFFSETS.first[CASE_COUNT] == CASE_POINT_COUNT, "case vertex counts must cover CASE_POINTS");
+
+// Finds the boundary site of a template point, false for points inside the square
+constexpr bool findWeldSite(float x, float y, WeldSite &site, int &slot) {
+	if (x == -1.0f || x == 1.0f) {
+		if (y == 1.0f || y == -1.0f) {
+			site = WELD_CORNER;
+			slot = (y == 1.0f ? 0 : 2) + (x == 1.0f ? 1 : 0);
+			return true;
+		}
+
+		site = x == -1.0f ? WELD_LEFT_EDGE : WELD_RIGHT_EDGE;
+		slot = y > 0.0f ? 0 : (y == 0.0f ? 1 : 2);
+		return true;
+	}
+
+	if (y == 1.0f || y == -1.0f) {
+		site = y == 1.0f ? WELD_TOP_EDGE : WELD_BOTTOM_EDGE;
+		slot = x < 0.0f ? 0 : (x == 0.0f ? 1 : 2);
+		return true;
+	}
+
+	return false;
+}
+
+constexpr CaseSites buildCaseSites() {
+	CaseSites sites = {};
+
+	for (int v = 0; v < CASE_POINT_COUNT; v++) {
+		WeldSite site = WELD_INTERIOR;
+		int slot = 0;
+
+		findWeldSite(CASE_POINTS[v].x, CASE_POINTS[v].y, site, slot);
+		sites.site[v] = (unsigned char)(site * 4 + slot);
+	}
+
+	return sites;
+}
+
+constexpr CaseSites CASE_SITES = buildCaseSites();
+
+#endif
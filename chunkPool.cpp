@@ -0,0 +1,52 @@
+/*
+	Marching Squares - Chunk Pool
+	Storage for one tile of a sparse grid, handed out when something reaches
+	the tile and taken back once the tile is empty again.
+*/
+
+#include <string.h>
+
+#include "chunkPool.h"
+
+////////////////////
+// class: ChunkPool
+////////////////
+
+// Returns a chunk with empty states and a zero field, reusing a released one when there is any
+GridChunk* ChunkPool::acquire() {
+	if (spare.empty()) {
+		chunks.push_back(std::unique_ptr<GridChunk>(new GridChunk()));
+		return chunks.back().get();
+	}
+
+	GridChunk *chunk = spare.back();
+	spare.pop_back();
+
+	return chunk;
+}
+
+// Whoever releases a chunk empties its states and zeroes its field first, knowing
+// which parts were written. Colors and stamps are left as they are.
+void ChunkPool::release(GridChunk *chunk) {
+	spare.push_back(chunk);
+}
+
+// Zeroes every chunk's stamps, for when the frame counter they're compared against wraps
+void ChunkPool::resetStamps() {
+	for (unsigned int i = 0; i < chunks.size(); i++) {
+		memset(chunks[i]->stamps, 0, sizeof(chunks[i]->stamps));
+	}
+}
+
+size_t ChunkPool::getInUse() {
+	return chunks.size() - spare.size();
+}
+
+size_t ChunkPool::getAllocated() {
+	return chunks.size();
+}
+
+size_t ChunkPool::getBytes() {
+	return chunks.size() * sizeof(GridChunk) + chunks.capacity() * sizeof(std::unique_ptr<GridChunk>)
+		+ spare.capacity() * sizeof(GridChunk*);
+}
@@ -0,0 +1,48 @@
+/*
+	Marching Squares - Chunk Pool
+	Storage for one tile of a sparse grid, handed out when something reaches
+	the tile and taken back once the tile is empty again.
+*/
+
+#ifndef CHUNK_POOL_H
+#define CHUNK_POOL_H
+
+#include <stddef.h>
+#include <memory>
+#include <vector>
+
+// Squares per side of a chunk, the same as a tile
+const int CHUNK_SIZE = 64;
+
+// Vertices per side of a chunk. The last row and column repeat the first ones
+// of the chunks below and to the right, so a chunk classifies on its own.
+const int CHUNK_VERTICES = CHUNK_SIZE + 1;
+
+typedef struct GridChunk {
+	unsigned char states[CHUNK_SIZE * CHUNK_SIZE];
+	unsigned char colors[CHUNK_SIZE * CHUNK_SIZE];
+	// Frame each square was last recorded in
+	unsigned int stamps[CHUNK_SIZE * CHUNK_SIZE];
+	float field[CHUNK_VERTICES * CHUNK_VERTICES];
+	unsigned char fieldColors[CHUNK_VERTICES * CHUNK_VERTICES];
+} GridChunk;
+
+// Chunks are never freed while the pool lives, released ones wait in a free
+// list for the next tile that needs storage. Stale colors are never read,
+// since a square's color is written whenever its case is, and stale stamps
+// never match as long as the frame counter only grows.
+class ChunkPool {
+	private:
+		std::vector<std::unique_ptr<GridChunk> > chunks;
+		std::vector<GridChunk*> spare;
+
+	public:
+		GridChunk* acquire();
+		void release(GridChunk *chunk);
+		void resetStamps();
+		size_t getInUse();
+		size_t getAllocated();
+		size_t getBytes();
+};
+
+#endif
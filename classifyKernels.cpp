@@ -0,0 +1,480 @@
+/*
+	Marching Squares - Classification Kernels
+	Scalar, SSE2 and AVX2 versions of the vertex field, corner and case
+	passes and of the ball movement pass, picked at runtime from what the
+	CPU supports.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "classifyKernels.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+	#define CLASSIFY_KERNELS_X86 1
+	#include <immintrin.h>
+#else
+	#define CLASSIFY_KERNELS_X86 0
+#endif
+
+void accumulateSpanScalar(const FieldSpan &span);
+void insideRowScalar(const CornerSpan &span);
+void classifyRowScalar(const float *upper, const float *lower, unsigned char *states, int count, float threshold);
+int moveBallsScalar(const BallSpan &span);
+
+#if CLASSIFY_KERNELS_X86
+void accumulateSpanSse2(const FieldSpan &span);
+void insideRowSse2(const CornerSpan &span);
+void classifyRowSse2(const float *upper, const float *lower, unsigned char *states, int count, float threshold);
+int moveBallsSse2(const BallSpan &span);
+void accumulateSpanAvx2(const FieldSpan &span);
+void insideRowAvx2(const CornerSpan &span);
+void classifyRowAvx2(const float *upper, const float *lower, unsigned char *states, int count, float threshold);
+int moveBallsAvx2(const BallSpan &span);
+#endif
+
+//////////////////
+// Kernel Tables
+//////////////
+
+const ClassifyKernels scalarKernels = { KERNEL_SCALAR, "scalar", &accumulateSpanScalar, &insideRowScalar, &classifyRowScalar, &moveBallsScalar };
+
+#if CLASSIFY_KERNELS_X86
+const ClassifyKernels sse2Kernels = { KERNEL_SSE2, "sse2", &accumulateSpanSse2, &insideRowSse2, &classifyRowSse2, &moveBallsSse2 };
+const ClassifyKernels avx2Kernels = { KERNEL_AVX2, "avx2", &accumulateSpanAvx2, &insideRowAvx2, &classifyRowAvx2, &moveBallsAvx2 };
+#endif
+
+////////////////
+// Dispatching
+////////////
+
+// Falls back level by level until the CPU supports the kernels
+const ClassifyKernels& getClassifyKernels(KernelLevel level) {
+#if CLASSIFY_KERNELS_X86
+	if (level == KERNEL_AVX2 && __builtin_cpu_supports("avx2")) {
+		return avx2Kernels;
+	}
+
+	if (level >= KERNEL_SSE2 && __builtin_cpu_supports("sse2")) {
+		return sse2Kernels;
+	}
+#endif
+
+	return scalarKernels;
+}
+
+const ClassifyKernels& getBestClassifyKernels() {
+	return getClassifyKernels(KERNEL_AVX2);
+}
+
+// Maps the command line names scalar, sse2 and avx2 onto levels
+bool parseKernelLevel(const char *name, KernelLevel &level) {
+	const char *names[] = { "scalar", "sse2", "avx2" };
+
+	for (int i = 0; i < 3; i++) {
+		if (strcmp(name, names[i]) == 0) {
+			level = static_cast<KernelLevel>(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+///////////////////
+// Scalar Kernels
+///////////////
+
+// Shared by every kernel for the vertices left over after its vector loop,
+// inlined so the wide kernels don't pay to switch back to legacy SSE code
+static inline void accumulateRange(const FieldSpan &span, int left) {
+	for (int j = left; j <= span.right; j++) {
+		float dx = j * span.width - span.extent - span.centerX;
+		float distSqr = dx * dx + span.dy * span.dy;
+
+		if (distSqr < span.limitSqr) {
+			if (span.metaball) {
+				float t = 1.0f - distSqr / span.limitSqr;
+				span.field[j] += t * t;
+			} else {
+				span.field[j] += 1.0f;
+			}
+
+			span.colors[j] = span.color;
+		}
+	}
+}
+
+// Ball::contains squares the float offsets in double, where the products are
+// exact, and along either axis through the center compares the distance itself
+static inline void insideRange(const CornerSpan &span, int left) {
+	for (int j = left; j <= span.right; j++) {
+		float dx = j * span.width - span.extent - span.centerX;
+		bool inside;
+
+		if (dx != 0.0f && span.dy != 0.0f) {
+			inside = (double)dx * dx + (double)span.dy * span.dy < (double)span.radiusSqr;
+		} else {
+			inside = fabsf(dx) + fabsf(span.dy) < span.radius;
+		}
+
+		span.inside[j] = inside ? 1.0f : 0.0f;
+	}
+}
+
+static inline void classifyRange(const float *upper, const float *lower, unsigned char *states, int first, int count, float threshold) {
+	for (int j = first; j < count; j++) {
+		states[j] = (upper[j] > threshold ? 1 : 0)
+			| (lower[j] > threshold ? 2 : 0)
+			| (lower[j + 1] > threshold ? 4 : 0)
+			| (upper[j + 1] > threshold ? 8 : 0);
+	}
+}
+
+// Position update and wall test in the same order of operations as Ball::move
+// and SceneBounds::outOfBounds, so every kernel moves balls bit for bit alike
+static inline int moveRange(const BallSpan &span, int first) {
+	int flagged = 0;
+
+	for (int i = first; i < span.count; i++) {
+		float x = span.x[i] + span.facingX[i] * span.speeds[i];
+		float y = span.y[i] + span.facingY[i] * span.speeds[i];
+		float radius = span.radii[i];
+		bool outside = x + radius > span.maxX || x - radius < span.minX || y + radius > span.maxY || y - radius < span.minY;
+		unsigned char flag = (outside && span.escaped[i] == 0) ? 1 : 0;
+
+		span.x[i] = x;
+		span.y[i] = y;
+		span.escaped[i] = flag;
+		flagged += flag;
+	}
+
+	return flagged;
+}
+
+void accumulateSpanScalar(const FieldSpan &span) {
+	accumulateRange(span, span.left);
+}
+
+void insideRowScalar(const CornerSpan &span) {
+	insideRange(span, span.left);
+}
+
+void classifyRowScalar(const float *upper, const float *lower, unsigned char *states, int count, float threshold) {
+	classifyRange(upper, lower, states, 0, count, threshold);
+}
+
+int moveBallsScalar(const BallSpan &span) {
+	return moveRange(span, 0);
+}
+
+#if CLASSIFY_KERNELS_X86
+
+// Writes color into the bytes whose bit is set in mask
+static inline void scatterColors(unsigned char *colors, int mask, unsigned char color) {
+	while (mask != 0) {
+		colors[__builtin_ctz(mask)] = color;
+		mask &= mask - 1;
+	}
+}
+
+/////////////////
+// SSE2 Kernels
+/////////////
+
+__attribute__((target("sse2")))
+void accumulateSpanSse2(const FieldSpan &span) {
+	const __m128 width = _mm_set1_ps(span.width);
+	const __m128 extent = _mm_set1_ps(span.extent);
+	const __m128 centerX = _mm_set1_ps(span.centerX);
+	const __m128 dySqr = _mm_set1_ps(span.dy * span.dy);
+	const __m128 limitSqr = _mm_set1_ps(span.limitSqr);
+	const __m128 one = _mm_set1_ps(1.0f);
+	__m128i index = _mm_add_epi32(_mm_set1_epi32(span.left), _mm_setr_epi32(0, 1, 2, 3));
+	int j = span.left;
+
+	for (; j + 3 <= span.right; j += 4) {
+		__m128 dx = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(index), width), extent), centerX);
+		__m128 distSqr = _mm_add_ps(_mm_mul_ps(dx, dx), dySqr);
+		__m128 inside = _mm_cmplt_ps(distSqr, limitSqr);
+		int mask = _mm_movemask_ps(inside);
+
+		index = _mm_add_epi32(index, _mm_set1_epi32(4));
+
+		if (mask == 0) {
+			continue;
+		}
+
+		__m128 contribution = one;
+		if (span.metaball) {
+			__m128 t = _mm_sub_ps(one, _mm_div_ps(distSqr, limitSqr));
+			contribution = _mm_mul_ps(t, t);
+		}
+
+		// Adding zero outside the ball leaves those vertices bit for bit unchanged
+		__m128 field = _mm_loadu_ps(span.field + j);
+		_mm_storeu_ps(span.field + j, _mm_add_ps(field, _mm_and_ps(contribution, inside)));
+		scatterColors(span.colors + j, mask, span.color);
+	}
+
+	accumulateRange(span, j);
+}
+
+// Squares four offsets at a time in two pairs of doubles, as insideRange does
+__attribute__((target("sse2")))
+void insideRowSse2(const CornerSpan &span) {
+	const __m128 width = _mm_set1_ps(span.width);
+	const __m128 extent = _mm_set1_ps(span.extent);
+	const __m128 centerX = _mm_set1_ps(span.centerX);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 absDy = _mm_set1_ps(fabsf(span.dy));
+	const __m128 radius = _mm_set1_ps(span.radius);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128d dySqr = _mm_set1_pd((double)span.dy * span.dy);
+	const __m128d radiusSqr = _mm_set1_pd(span.radiusSqr);
+	// On the row through the center every corner takes the axis test
+	const __m128 axisRow = span.dy == 0.0f ? _mm_cmpeq_ps(zero, zero) : zero;
+	__m128i index = _mm_add_epi32(_mm_set1_epi32(span.left), _mm_setr_epi32(0, 1, 2, 3));
+	int j = span.left;
+
+	for (; j + 3 <= span.right; j += 4) {
+		__m128 dx = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(index), width), extent), centerX);
+		__m128d lowX = _mm_cvtps_pd(dx);
+		__m128d highX = _mm_cvtps_pd(_mm_movehl_ps(dx, dx));
+		__m128d lowInside = _mm_cmplt_pd(_mm_add_pd(_mm_mul_pd(lowX, lowX), dySqr), radiusSqr);
+		__m128d highInside = _mm_cmplt_pd(_mm_add_pd(_mm_mul_pd(highX, highX), dySqr), radiusSqr);
+
+		// Narrowing the 64 bit masks back to one 32 bit lane per corner
+		__m128 inside = _mm_shuffle_ps(_mm_castpd_ps(lowInside), _mm_castpd_ps(highInside), _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 axis = _mm_or_ps(_mm_cmpeq_ps(dx, zero), axisRow);
+		__m128 axisInside = _mm_cmplt_ps(_mm_add_ps(_mm_and_ps(dx, absMask), absDy), radius);
+
+		inside = _mm_or_ps(_mm_and_ps(axis, axisInside), _mm_andnot_ps(axis, inside));
+		_mm_storeu_ps(span.inside + j, _mm_and_ps(inside, one));
+		index = _mm_add_epi32(index, _mm_set1_epi32(4));
+	}
+
+	insideRange(span, j);
+}
+
+__attribute__((target("sse2")))
+void classifyRowSse2(const float *upper, const float *lower, unsigned char *states, int count, float threshold) {
+	const __m128 limit = _mm_set1_ps(threshold);
+	int j = 0;
+
+	for (; j + 4 <= count; j += 4) {
+		// Corner bits 1, 2, 4 and 8 from the four shifted vertex loads
+		__m128i topLeft = _mm_and_si128(_mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(upper + j), limit)), _mm_set1_epi32(1));
+		__m128i botLeft = _mm_and_si128(_mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(lower + j), limit)), _mm_set1_epi32(2));
+		__m128i botRight = _mm_and_si128(_mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(lower + j + 1), limit)), _mm_set1_epi32(4));
+		__m128i topRight = _mm_and_si128(_mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(upper + j + 1), limit)), _mm_set1_epi32(8));
+		__m128i cases = _mm_or_si128(_mm_or_si128(topLeft, botLeft), _mm_or_si128(botRight, topRight));
+
+		// Narrowing 32 bit lanes to bytes
+		cases = _mm_packs_epi32(cases, cases);
+		cases = _mm_packus_epi16(cases, cases);
+
+		int packed = _mm_cvtsi128_si32(cases);
+		memcpy(states + j, &packed, 4);
+	}
+
+	classifyRange(upper, lower, states, j, count, threshold);
+}
+
+__attribute__((target("sse2")))
+int moveBallsSse2(const BallSpan &span) {
+	const __m128 minX = _mm_set1_ps(span.minX);
+	const __m128 maxX = _mm_set1_ps(span.maxX);
+	const __m128 minY = _mm_set1_ps(span.minY);
+	const __m128 maxY = _mm_set1_ps(span.maxY);
+	const __m128i zero = _mm_setzero_si128();
+	int flagged = 0;
+	int i = 0;
+
+	for (; i + 4 <= span.count; i += 4) {
+		__m128 speed = _mm_loadu_ps(span.speeds + i);
+		__m128 x = _mm_add_ps(_mm_loadu_ps(span.x + i), _mm_mul_ps(_mm_loadu_ps(span.facingX + i), speed));
+		__m128 y = _mm_add_ps(_mm_loadu_ps(span.y + i), _mm_mul_ps(_mm_loadu_ps(span.facingY + i), speed));
+		__m128 radius = _mm_loadu_ps(span.radii + i);
+		__m128 outside = _mm_or_ps(
+			_mm_or_ps(_mm_cmpgt_ps(_mm_add_ps(x, radius), maxX), _mm_cmplt_ps(_mm_sub_ps(x, radius), minX)),
+			_mm_or_ps(_mm_cmpgt_ps(_mm_add_ps(y, radius), maxY), _mm_cmplt_ps(_mm_sub_ps(y, radius), minY)));
+
+		_mm_storeu_ps(span.x + i, x);
+		_mm_storeu_ps(span.y + i, y);
+
+		// Widening last step's flags to 32 bit lanes, then flagging only balls that weren't already out
+		int bytes;
+		memcpy(&bytes, span.escaped + i, 4);
+		__m128i wasOut = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+		__m128 flags = _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(wasOut, zero)), outside);
+
+		__m128i packed = _mm_and_si128(_mm_castps_si128(flags), _mm_set1_epi32(1));
+		packed = _mm_packs_epi32(packed, packed);
+		packed = _mm_packus_epi16(packed, packed);
+		bytes = _mm_cvtsi128_si32(packed);
+		memcpy(span.escaped + i, &bytes, 4);
+
+		flagged += __builtin_popcount(_mm_movemask_ps(flags));
+	}
+
+	return flagged + moveRange(span, i);
+}
+
+/////////////////
+// AVX2 Kernels
+/////////////
+
+__attribute__((target("avx2")))
+void accumulateSpanAvx2(const FieldSpan &span) {
+	const __m256 width = _mm256_set1_ps(span.width);
+	const __m256 extent = _mm256_set1_ps(span.extent);
+	const __m256 centerX = _mm256_set1_ps(span.centerX);
+	const __m256 dySqr = _mm256_set1_ps(span.dy * span.dy);
+	const __m256 limitSqr = _mm256_set1_ps(span.limitSqr);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	__m256i index = _mm256_add_epi32(_mm256_set1_epi32(span.left), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	int j = span.left;
+
+	for (; j + 7 <= span.right; j += 8) {
+		__m256 dx = _mm256_sub_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(index), width), extent), centerX);
+		__m256 distSqr = _mm256_add_ps(_mm256_mul_ps(dx, dx), dySqr);
+		__m256 inside = _mm256_cmp_ps(distSqr, limitSqr, _CMP_LT_OQ);
+		int mask = _mm256_movemask_ps(inside);
+
+		index = _mm256_add_epi32(index, _mm256_set1_epi32(8));
+
+		if (mask == 0) {
+			continue;
+		}
+
+		__m256 contribution = one;
+		if (span.metaball) {
+			__m256 t = _mm256_sub_ps(one, _mm256_div_ps(distSqr, limitSqr));
+			contribution = _mm256_mul_ps(t, t);
+		}
+
+		// Adding zero outside the ball leaves those vertices bit for bit unchanged
+		__m256 field = _mm256_loadu_ps(span.field + j);
+		_mm256_storeu_ps(span.field + j, _mm256_add_ps(field, _mm256_and_ps(contribution, inside)));
+		scatterColors(span.colors + j, mask, span.color);
+	}
+
+	accumulateRange(span, j);
+}
+
+// Squares eight offsets at a time in two sets of four doubles, as insideRange does
+__attribute__((target("avx2")))
+void insideRowAvx2(const CornerSpan &span) {
+	const __m256 width = _mm256_set1_ps(span.width);
+	const __m256 extent = _mm256_set1_ps(span.extent);
+	const __m256 centerX = _mm256_set1_ps(span.centerX);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	const __m256 absDy = _mm256_set1_ps(fabsf(span.dy));
+	const __m256 radius = _mm256_set1_ps(span.radius);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256d dySqr = _mm256_set1_pd((double)span.dy * span.dy);
+	const __m256d radiusSqr = _mm256_set1_pd(span.radiusSqr);
+	const __m256i evenLanes = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+	// On the row through the center every corner takes the axis test
+	const __m256 axisRow = span.dy == 0.0f ? _mm256_castsi256_ps(_mm256_set1_epi32(-1)) : zero;
+	__m256i index = _mm256_add_epi32(_mm256_set1_epi32(span.left), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	int j = span.left;
+
+	for (; j + 7 <= span.right; j += 8) {
+		__m256 dx = _mm256_sub_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(index), width), extent), centerX);
+		__m256d lowX = _mm256_cvtps_pd(_mm256_castps256_ps128(dx));
+		__m256d highX = _mm256_cvtps_pd(_mm256_extractf128_ps(dx, 1));
+		__m256d lowInside = _mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(lowX, lowX), dySqr), radiusSqr, _CMP_LT_OQ);
+		__m256d highInside = _mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(highX, highX), dySqr), radiusSqr, _CMP_LT_OQ);
+
+		// Narrowing the 64 bit masks back to one 32 bit lane per corner
+		__m256 inside = _mm256_blend_ps(_mm256_permutevar8x32_ps(_mm256_castpd_ps(lowInside), evenLanes),
+			_mm256_permutevar8x32_ps(_mm256_castpd_ps(highInside), evenLanes), 0xF0);
+		__m256 axis = _mm256_or_ps(_mm256_cmp_ps(dx, zero, _CMP_EQ_OQ), axisRow);
+		__m256 axisInside = _mm256_cmp_ps(_mm256_add_ps(_mm256_and_ps(dx, absMask), absDy), radius, _CMP_LT_OQ);
+
+		inside = _mm256_blendv_ps(inside, axisInside, axis);
+		_mm256_storeu_ps(span.inside + j, _mm256_and_ps(inside, one));
+		index = _mm256_add_epi32(index, _mm256_set1_epi32(8));
+	}
+
+	insideRange(span, j);
+}
+
+__attribute__((target("avx2")))
+void classifyRowAvx2(const float *upper, const float *lower, unsigned char *states, int count, float threshold) {
+	const __m256 limit = _mm256_set1_ps(threshold);
+	int j = 0;
+
+	for (; j + 8 <= count; j += 8) {
+		// Corner bits 1, 2, 4 and 8 from the four shifted vertex loads
+		__m256i topLeft = _mm256_and_si256(_mm256_castps_si256(
+			_mm256_cmp_ps(_mm256_loadu_ps(upper + j), limit, _CMP_GT_OQ)), _mm256_set1_epi32(1));
+		__m256i botLeft = _mm256_and_si256(_mm256_castps_si256(
+			_mm256_cmp_ps(_mm256_loadu_ps(lower + j), limit, _CMP_GT_OQ)), _mm256_set1_epi32(2));
+		__m256i botRight = _mm256_and_si256(_mm256_castps_si256(
+			_mm256_cmp_ps(_mm256_loadu_ps(lower + j + 1), limit, _CMP_GT_OQ)), _mm256_set1_epi32(4));
+		__m256i topRight = _mm256_and_si256(_mm256_castps_si256(
+			_mm256_cmp_ps(_mm256_loadu_ps(upper + j + 1), limit, _CMP_GT_OQ)), _mm256_set1_epi32(8));
+		__m256i cases = _mm256_or_si256(_mm256_or_si256(topLeft, botLeft), _mm256_or_si256(botRight, topRight));
+
+		// Narrowing within each 128 bit lane leaves four cases at the bottom of each
+		cases = _mm256_packus_epi32(cases, cases);
+		cases = _mm256_packus_epi16(cases, cases);
+
+		int low = _mm_cvtsi128_si32(_mm256_castsi256_si128(cases));
+		int high = _mm_cvtsi128_si32(_mm256_extracti128_si256(cases, 1));
+		memcpy(states + j, &low, 4);
+		memcpy(states + j + 4, &high, 4);
+	}
+
+	classifyRange(upper, lower, states, j, count, threshold);
+}
+
+__attribute__((target("avx2")))
+int moveBallsAvx2(const BallSpan &span) {
+	const __m256 minX = _mm256_set1_ps(span.minX);
+	const __m256 maxX = _mm256_set1_ps(span.maxX);
+	const __m256 minY = _mm256_set1_ps(span.minY);
+	const __m256 maxY = _mm256_set1_ps(span.maxY);
+	int flagged = 0;
+	int i = 0;
+
+	for (; i + 8 <= span.count; i += 8) {
+		__m256 speed = _mm256_loadu_ps(span.speeds + i);
+		__m256 x = _mm256_add_ps(_mm256_loadu_ps(span.x + i), _mm256_mul_ps(_mm256_loadu_ps(span.facingX + i), speed));
+		__m256 y = _mm256_add_ps(_mm256_loadu_ps(span.y + i), _mm256_mul_ps(_mm256_loadu_ps(span.facingY + i), speed));
+		__m256 radius = _mm256_loadu_ps(span.radii + i);
+		__m256 outside = _mm256_or_ps(
+			_mm256_or_ps(_mm256_cmp_ps(_mm256_add_ps(x, radius), maxX, _CMP_GT_OQ),
+				_mm256_cmp_ps(_mm256_sub_ps(x, radius), minX, _CMP_LT_OQ)),
+			_mm256_or_ps(_mm256_cmp_ps(_mm256_add_ps(y, radius), maxY, _CMP_GT_OQ),
+				_mm256_cmp_ps(_mm256_sub_ps(y, radius), minY, _CMP_LT_OQ)));
+
+		_mm256_storeu_ps(span.x + i, x);
+		_mm256_storeu_ps(span.y + i, y);
+
+		// Widening last step's flags to 32 bit lanes, then flagging only balls that weren't already out
+		__m256i wasOut = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(span.escaped + i)));
+		__m256 flags = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(wasOut, _mm256_setzero_si256())), outside);
+
+		// Narrowing within each 128 bit lane leaves four flags at the bottom of each
+		__m256i packed = _mm256_and_si256(_mm256_castps_si256(flags), _mm256_set1_epi32(1));
+		packed = _mm256_packus_epi32(packed, packed);
+		packed = _mm256_packus_epi16(packed, packed);
+
+		int low = _mm_cvtsi128_si32(_mm256_castsi256_si128(packed));
+		int high = _mm_cvtsi128_si32(_mm256_extracti128_si256(packed, 1));
+		memcpy(span.escaped + i, &low, 4);
+		memcpy(span.escaped + i + 4, &high, 4);
+
+		flagged += __builtin_popcount(_mm256_movemask_ps(flags));
+	}
+
+	return flagged + moveRange(span, i);
+}
+
+#endif
@@ -0,0 +1,87 @@
+/*
+	Marching Squares - Classification Kernels
+	Scalar, SSE2 and AVX2 versions of the vertex field, corner and case
+	passes and of the ball movement pass, picked at runtime from what the
+	CPU supports.
+*/
+
+#ifndef CLASSIFY_KERNELS_H
+#define CLASSIFY_KERNELS_H
+
+typedef enum KernelLevel {
+	KERNEL_SCALAR,
+	KERNEL_SSE2,
+	KERNEL_AVX2
+} KernelLevel;
+
+// One ball's contribution to one row of vertices. Vertex j sits at
+// x = j * width - extent, and dx is computed in exactly that order by every
+// kernel so all of them produce bit identical fields.
+typedef struct FieldSpan {
+	float *field;
+	unsigned char *colors;
+	int left;
+	int right;
+	float width;
+	float extent;
+	float centerX;
+	float dy;
+	// Squared distance a vertex must be inside to be touched
+	float limitSqr;
+	bool metaball;
+	unsigned char color;
+} FieldSpan;
+
+// One ball tested against one row of corners, with corner j at
+// x = j * width - extent as in FieldSpan. Each corner gets 1 if it is inside
+// the ball by exactly the test Ball::contains makes, and 0 otherwise.
+typedef struct CornerSpan {
+	float *inside;
+	int left;
+	int right;
+	float width;
+	float extent;
+	float centerX;
+	// The row's y minus the ball's
+	float dy;
+	float radius;
+	// Rounded to float, as Ball::contains compares against it
+	float radiusSqr;
+} CornerSpan;
+
+// Every ball's fields, one array each, and the walls they bounce off. Each
+// ball moves by its facing times its speed, then a ball past a wall is flagged
+// for the step it crosses it and cleared the step after, as Ball does.
+typedef struct BallSpan {
+	float *x;
+	float *y;
+	const float *facingX;
+	const float *facingY;
+	const float *speeds;
+	const float *radii;
+	unsigned char *escaped;
+	int count;
+	float minX;
+	float maxX;
+	float minY;
+	float maxY;
+} BallSpan;
+
+typedef struct ClassifyKernels {
+	KernelLevel level;
+	const char *name;
+	// Adds a ball's occupancy or metaball kernel to the vertices in [left, right]
+	void (*accumulateSpan)(const FieldSpan &span);
+	// Marks the corners in [left, right] inside a ball with 1 and the rest with 0
+	void (*insideRow)(const CornerSpan &span);
+	// Writes count cases from two vertex rows, upper[count] and lower[count] must be readable
+	void (*classifyRow)(const float *upper, const float *lower, unsigned char *states, int count, float threshold);
+	// Moves every ball one step and returns how many were newly flagged
+	int (*moveBalls)(const BallSpan &span);
+} ClassifyKernels;
+
+const ClassifyKernels& getClassifyKernels(KernelLevel level);
+const ClassifyKernels& getBestClassifyKernels();
+bool parseKernelLevel(const char *name, KernelLevel &level);
+
+#endif
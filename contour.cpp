@@ -0,0 +1,163 @@
+/*
+	Marching Squares - Contour
+	Contours a raster file through ScanlineContour, writing its squares or
+	outline segments as text, and reports throughput on stderr. Files are
+	memory mapped and may carry a PGM or PFM header, stdin is read as raw rows.
+
+	Usage: contour [--width N] [--type uint8|float32] [--threshold T] [--output cells|segments|none] [--kernel scalar|sse2|avx2] [--rows FIRST:LAST] input|- [output|-]
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include "mappedRaster.h"
+#include "scanlineContour.h"
+
+/////////////////////////
+// Default Settings
+/////////////////////
+
+// Halfway up the uint8 range, and halfway between 0 and 1 for float32
+const float DEFAULT_UINT8_THRESHOLD = 127.5f;
+const float DEFAULT_FLOAT_THRESHOLD = 0.5f;
+const size_t OUTPUT_BUFFER_BYTES = 1 << 20;
+
+void printUsage(const char *program);
+
+///////////
+// main()
+///////
+
+int main(int argc, char *argv[]) {
+	int width = 0;
+	RasterType type = RASTER_UINT8;
+	float threshold = 0.0f;
+	bool thresholdSet = false;
+	ContourOutput output = CONTOUR_SEGMENTS;
+	KernelLevel kernelLevel = KERNEL_AVX2;
+	// Vertex rows to contour from a mapped file, the whole raster by default
+	long long firstRow = 0;
+	long long lastRow = -1;
+	const char *inputName = NULL;
+	const char *outputName = "-";
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+			width = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+			threshold = (float)atof(argv[++i]);
+			thresholdSet = true;
+		} else if (strcmp(argv[i], "--type") == 0 && i + 1 < argc) {
+			if (!parseRasterType(argv[++i], type)) {
+				printUsage(argv[0]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			if (!parseContourOutput(argv[++i], output)) {
+				printUsage(argv[0]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+			if (!parseKernelLevel(argv[++i], kernelLevel)) {
+				printUsage(argv[0]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%lld:%lld", &firstRow, &lastRow) != 2 || firstRow < 0 || lastRow <= firstRow) {
+				printUsage(argv[0]);
+				return 1;
+			}
+		} else if (argv[i][0] == '-' && argv[i][1] == '-') {
+			printUsage(argv[0]);
+			return 1;
+		} else if (inputName == NULL) {
+			inputName = argv[i];
+		} else {
+			outputName = argv[i];
+		}
+	}
+
+	if (inputName == NULL) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	bool mapped = strcmp(inputName, "-") != 0;
+	MappedRaster raster;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	if (mapped) {
+		if (!raster.open(inputName, width, type)) {
+			fprintf(stderr, "contour: %s: %s\n", inputName, raster.getError());
+			return 1;
+		}
+
+		width = raster.getWidth();
+		type = raster.getType();
+		lastRow = lastRow < 0 || lastRow >= raster.getHeight() ? raster.getHeight() - 1 : lastRow;
+	}
+
+	std::chrono::duration<double> mapping = std::chrono::steady_clock::now() - start;
+
+	if (width < 2) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	if (!thresholdSet) {
+		threshold = type == RASTER_UINT8 ? DEFAULT_UINT8_THRESHOLD : DEFAULT_FLOAT_THRESHOLD;
+	}
+
+	FILE *out = strcmp(outputName, "-") == 0 ? stdout : fopen(outputName, "w");
+	if (out == NULL) {
+		fprintf(stderr, "contour: can't open %s\n", outputName);
+		return 1;
+	}
+
+	setvbuf(out, NULL, _IOFBF, OUTPUT_BUFFER_BYTES);
+
+	ScanlineContour contour(width, type, threshold, output, out);
+	contour.setKernelLevel(kernelLevel);
+
+	start = std::chrono::steady_clock::now();
+	long long rows = 0;
+
+	if (!mapped) {
+		rows = contour.streamFile(stdin);
+	} else if (firstRow <= lastRow) {
+		if (firstRow == 0 && lastRow == raster.getHeight() - 1) {
+			raster.adviseSequential();
+		}
+
+		rows = contour.streamRaster(raster, firstRow, lastRow);
+	}
+
+	fflush(out);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	double megabytes = rows * (double)contour.getRowBytes() / (1024.0 * 1024.0);
+
+	fprintf(stderr, "raster: %dx%lld %s, threshold: %g, kernels: %s\n", width, rows,
+		type == RASTER_UINT8 ? "uint8" : "float32", threshold, contour.getKernels().name);
+	fprintf(stderr, "cells: %lld, segments: %lld, row memory: %.1f KB\n", contour.getCells(), contour.getSegments(),
+		contour.getBytes() / 1024.0);
+	fprintf(stderr, "seconds: %.3f, MB/s: %.1f\n", elapsed.count(), megabytes / elapsed.count());
+
+	if (mapped) {
+		fprintf(stderr, "mapped in %.3f ms, rows %s\n", mapping.count() * 1000.0,
+			type == RASTER_FLOAT32 && raster.isAligned() ? "read in place" : "converted one at a time");
+	}
+
+	if (out != stdout) {
+		fclose(out);
+	}
+
+	return 0;
+}
+
+void printUsage(const char *program) {
+	fprintf(stderr, "Usage: %s [--width N] [--type uint8|float32] [--threshold T] [--output cells|segments|none] [--kernel scalar|sse2|avx2] [--rows FIRST:LAST] input|- [output|-]\n", program);
+}
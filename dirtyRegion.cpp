@@ -0,0 +1,100 @@
+/*
+	Marching Squares - Dirty Region
+	Rows of disjoint column spans covering the part of the grid that has
+	to be reclassified this frame.
+*/
+
+#include <algorithm>
+
+#include "dirtyRegion.h"
+
+///////////////////////
+// class: DirtyRegion
+///////////////////
+
+DirtyRegion::DirtyRegion() {
+	bounds = GridWindow{ 0, 0, -1, -1 };
+}
+
+// Sizes the region for rowCount rows, forgetting everything added
+void DirtyRegion::reset(int rowCount) {
+	spans.assign(rowCount, std::vector<Span>());
+	rows.clear();
+	bounds = GridWindow{ 0, 0, -1, -1 };
+}
+
+// Empties only the rows touched since the last clear
+void DirtyRegion::clear() {
+	for (unsigned int i = 0; i < rows.size(); i++) {
+		spans[rows[i]].clear();
+	}
+
+	rows.clear();
+	bounds = GridWindow{ 0, 0, -1, -1 };
+}
+
+// Adds a window already clamped to the grid, empty windows are ignored
+void DirtyRegion::add(const GridWindow &window) {
+	if (window.top > window.bottom || window.left > window.right) {
+		return;
+	}
+
+	for (int i = window.top; i <= window.bottom; i++) {
+		if (spans[i].empty()) {
+			rows.push_back(i);
+		}
+
+		spans[i].push_back(Span{ window.left, window.right });
+	}
+
+	if (bounds.top > bounds.bottom) {
+		bounds = window;
+	} else {
+		bounds.top = window.top < bounds.top ? window.top : bounds.top;
+		bounds.left = window.left < bounds.left ? window.left : bounds.left;
+		bounds.bottom = window.bottom > bounds.bottom ? window.bottom : bounds.bottom;
+		bounds.right = window.right > bounds.right ? window.right : bounds.right;
+	}
+}
+
+// Sorts the rows and merges overlapping or touching spans within each
+void DirtyRegion::finish() {
+	std::sort(rows.begin(), rows.end());
+
+	for (unsigned int i = 0; i < rows.size(); i++) {
+		std::vector<Span> &row = spans[rows[i]];
+
+		if (row.size() < 2) {
+			continue;
+		}
+
+		std::sort(row.begin(), row.end(), [](const Span &a, const Span &b) { return a.left < b.left; });
+
+		unsigned int merged = 0;
+		for (unsigned int s = 1; s < row.size(); s++) {
+			if (row[s].left <= row[merged].right + 1) {
+				row[merged].right = row[s].right > row[merged].right ? row[s].right : row[merged].right;
+			} else {
+				row[++merged] = row[s];
+			}
+		}
+
+		row.resize(merged + 1);
+	}
+}
+
+bool DirtyRegion::empty() {
+	return rows.empty();
+}
+
+const std::vector<int>& DirtyRegion::getRows() {
+	return rows;
+}
+
+const std::vector<Span>& DirtyRegion::getSpans(int row) {
+	return spans[row];
+}
+
+GridWindow DirtyRegion::getBounds() {
+	return bounds;
+}
@@ -0,0 +1,46 @@
+/*
+	Marching Squares - Dirty Region
+	Rows of disjoint column spans covering the part of the grid that has
+	to be reclassified this frame.
+*/
+
+#ifndef DIRTY_REGION_H
+#define DIRTY_REGION_H
+
+#include <vector>
+
+// Rectangle of squares or vertices, inclusive, empty when bottom < top
+typedef struct GridWindow {
+	int top;
+	int left;
+	int bottom;
+	int right;
+} GridWindow;
+
+// Columns left to right of one row, inclusive
+typedef struct Span {
+	int left;
+	int right;
+} Span;
+
+// Windows are added as they come, then finish() sorts the touched rows and
+// merges each row's spans so every cell appears in exactly one span.
+class DirtyRegion {
+	private:
+		std::vector<std::vector<Span> > spans;
+		std::vector<int> rows;
+		GridWindow bounds;
+
+	public:
+		DirtyRegion();
+		void reset(int rowCount);
+		void clear();
+		void add(const GridWindow &window);
+		void finish();
+		bool empty();
+		const std::vector<int>& getRows();
+		const std::vector<Span>& getSpans(int row);
+		GridWindow getBounds();
+};
+
+#endif
@@ -0,0 +1,185 @@
+/*
+	Marching Squares - Frame Producer
+	Steps the engine and builds each frame's mesh on a thread of its own,
+	publishing finished frames for the render thread through a triple buffer.
+*/
+
+#include <algorithm>
+#include <chrono>
+
+#include "frameProducer.h"
+
+////////////////////////
+// class: FrameProducer
+////////////////////
+
+FrameProducer::FrameProducer(MarchingSquaresEngine &engine) : engine(engine) {
+	running = false;
+	meshKind = MESH_BATCHED;
+	overlays = 0;
+	produced = 0;
+	stepRate = DEFAULT_STEP_RATE;
+	lastFrame = 0;
+}
+
+FrameProducer::~FrameProducer() {
+	stop();
+}
+
+// Starts stepping on a new thread, stepRate times a second or as fast as it can at zero.
+// A non-zero frameCount stops stepping after that many frames, still waiting for stop.
+void FrameProducer::start(double stepRate, unsigned long long frameCount) {
+	stop();
+
+	this->stepRate = stepRate;
+	lastFrame = frameCount != 0 ? produced.load() + frameCount : 0;
+
+	// Nothing has been published yet, so the reader's slot describes an empty grid
+	ProducedFrame &front = frames.getFront();
+	front.mesh.clear();
+	front.kind = static_cast<MeshKind>(meshKind.load());
+	front.squareWidth = engine.getSquareWidth();
+	front.dimension = engine.getDimension();
+	clearFrameStats(front.stats);
+	front.sequence = 0;
+
+	running = true;
+	thread = std::thread(&FrameProducer::run, this);
+}
+
+// Waits for the frame in progress to be published, after which the engine is the caller's again
+void FrameProducer::stop() {
+	running = false;
+
+	if (thread.joinable()) {
+		thread.join();
+	}
+
+	// Commands posted too late to run are run now, in order
+	runCommands();
+}
+
+void FrameProducer::run() {
+	nameTraceThread("producer");
+
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::duration period = std::chrono::steady_clock::duration::zero();
+
+	if (stepRate > 0.0) {
+		period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / stepRate));
+	}
+
+	while (running.load(std::memory_order_relaxed) && (lastFrame == 0 || produced.load(std::memory_order_relaxed) < lastFrame)) {
+		runCommands();
+
+		// Moving shapes and classifying the squares they cover
+		engine.step();
+
+		// The slot is the reader's once published, so the count is kept aside
+		unsigned long long sequence = produced.load(std::memory_order_relaxed) + 1;
+		ProducedFrame &frame = frames.getBack();
+		buildFrame(frame);
+		frame.sequence = sequence;
+		frames.publish();
+		produced.store(sequence, std::memory_order_release);
+
+		if (period != std::chrono::steady_clock::duration::zero()) {
+			// Falling behind drops the missed steps rather than rushing to catch up
+			next = std::max(next + period, std::chrono::steady_clock::now());
+			std::this_thread::sleep_until(next);
+		}
+	}
+}
+
+// Runs what was posted since the last frame, outside the lock so posting never waits on a command
+void FrameProducer::runCommands() {
+	TraceScope trace("commands");
+
+	{
+		std::lock_guard<std::mutex> guard(commandLock);
+		pending.swap(commands);
+	}
+
+	for (unsigned int i = 0; i < pending.size(); i++) {
+		pending[i](engine);
+	}
+
+	pending.clear();
+}
+
+// Writes the engine's current squares in the requested form, and the requested overlays, into frame
+void FrameProducer::buildFrame(ProducedFrame &frame) {
+	MeshBuilder &mesh = frame.mesh;
+	unsigned int flags = overlays.load(std::memory_order_relaxed);
+
+	frame.kind = static_cast<MeshKind>(meshKind.load(std::memory_order_relaxed));
+	frame.squareWidth = engine.getSquareWidth();
+	frame.dimension = engine.getDimension();
+	frame.stats = engine.getStats();
+
+	bool timed = engine.isStatsEnabled();
+	StageTimer meshTimer(frame.stats, STAGE_MESH, timed);
+
+	mesh.clear();
+
+	if (frame.kind == MESH_INSTANCED) {
+		mesh.addInstances(engine);
+	} else if (frame.kind == MESH_INDEXED) {
+		mesh.addIndexedSquares(engine);
+	} else {
+		mesh.addSquares(engine);
+	}
+
+	if (flags & OVERLAY_SQUARES) {
+		mesh.addSquareOutlines(engine);
+	}
+
+	if (flags & OVERLAY_BALLS) {
+		BallStore &balls = engine.getBalls();
+
+		for (unsigned int i = 0; i < balls.size(); i++) {
+			mesh.addCircle(balls.getPosition(i), balls.getRadius(i));
+		}
+	}
+
+	// Note: This only works for the square most recently returned by findSquare()
+	int centerSquare = engine.getCenterSquare();
+
+	if ((flags & OVERLAY_CENTER) && centerSquare != NULL_SQUARE) {
+		mesh.addSquareOutline(engine, centerSquare);
+	}
+
+	meshTimer.stop();
+
+	if (timed) {
+		frame.stats.triangles = mesh.getTriangleCount();
+	}
+}
+
+void FrameProducer::setMeshKind(MeshKind kind) {
+	meshKind.store(kind, std::memory_order_relaxed);
+}
+
+void FrameProducer::setOverlays(unsigned int overlays) {
+	this->overlays.store(overlays, std::memory_order_relaxed);
+}
+
+// Queues a change to the engine, run on the producer's thread before its next step
+void FrameProducer::post(const std::function<void(MarchingSquaresEngine&)> &command) {
+	std::lock_guard<std::mutex> guard(commandLock);
+	commands.push_back(command);
+}
+
+// Makes the latest published frame the one getFrame returns, false if none was published since the last call
+bool FrameProducer::acquire() {
+	return frames.acquire();
+}
+
+// The frame last acquired, left alone by the producer until the next acquire
+ProducedFrame& FrameProducer::getFrame() {
+	return frames.getFront();
+}
+
+unsigned long long FrameProducer::getProduced() {
+	return produced.load(std::memory_order_acquire);
+}
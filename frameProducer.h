@@ -0,0 +1,89 @@
+/*
+	Marching Squares - Frame Producer
+	Steps the engine and builds each frame's mesh on a thread of its own,
+	publishing finished frames for the render thread through a triple buffer.
+*/
+
+#ifndef FRAME_PRODUCER_H
+#define FRAME_PRODUCER_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "frameStats.h"
+#include "marchingSquaresEngine.h"
+#include "meshBuilder.h"
+#include "tripleBuffer.h"
+
+// Steps per second the viewer's simulation runs at, about one per displayed frame
+const double DEFAULT_STEP_RATE = 60.0;
+
+typedef enum MeshKind {
+	// Every square's triangles in one vertex array
+	MESH_BATCHED,
+	// Per-case instance records against the case templates
+	MESH_INSTANCED,
+	// Shared corner and edge points drawn through an index array
+	MESH_INDEXED
+} MeshKind;
+
+// Outlines added to the frame's line segments, combined as flags
+typedef enum FrameOverlay {
+	OVERLAY_SQUARES = 1,
+	OVERLAY_CENTER = 2,
+	OVERLAY_BALLS = 4
+} FrameOverlay;
+
+// Everything the render thread needs to draw a frame without touching the engine
+typedef struct ProducedFrame {
+	MeshBuilder mesh;
+	MeshKind kind;
+	float squareWidth;
+	float dimension;
+	// The engine's stats for the step plus the mesh build, zeros unless the engine is recording them
+	FrameStats stats;
+	// Counts up from 1 with every frame produced
+	unsigned long long sequence;
+} ProducedFrame;
+
+// Once started, the engine belongs to the producer's thread until stop. Mesh
+// kind and overlays are read at the start of every frame. Anything else that
+// changes the engine is posted as a command and run between frames.
+class FrameProducer {
+	private:
+		MarchingSquaresEngine &engine;
+		TripleBuffer<ProducedFrame> frames;
+		std::thread thread;
+		std::atomic<bool> running;
+		std::atomic<int> meshKind;
+		std::atomic<unsigned int> overlays;
+		std::atomic<unsigned long long> produced;
+		std::mutex commandLock;
+		std::vector<std::function<void(MarchingSquaresEngine&)> > commands;
+		std::vector<std::function<void(MarchingSquaresEngine&)> > pending;
+		// Zero runs unpaced
+		double stepRate;
+		// The thread stops by itself once produced reaches this, never at zero
+		unsigned long long lastFrame;
+
+		void run();
+		void runCommands();
+		void buildFrame(ProducedFrame &frame);
+
+	public:
+		FrameProducer(MarchingSquaresEngine &engine);
+		~FrameProducer();
+		void start(double stepRate = DEFAULT_STEP_RATE, unsigned long long frameCount = 0);
+		void stop();
+		void setMeshKind(MeshKind kind);
+		void setOverlays(unsigned int overlays);
+		void post(const std::function<void(MarchingSquaresEngine&)> &command);
+		bool acquire();
+		ProducedFrame& getFrame();
+		unsigned long long getProduced();
+};
+
+#endif
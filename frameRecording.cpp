@@ -0,0 +1,360 @@
+/*
+	Marching Squares - Frame Recording
+	Compact binary recordings of the balls each frame was classified with,
+	and optionally the cases it produced, so a run can be replayed exactly.
+*/
+
+#include <string.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "frameRecording.h"
+
+//////////////////////
+// class: FrameWriter
+//////////////////
+
+FrameWriter::FrameWriter() {
+	file = NULL;
+	cases = false;
+	mode = 0;
+	frames = 0;
+	bytes = 0;
+}
+
+FrameWriter::~FrameWriter() {
+	close();
+}
+
+// Starts a recording of engine's frames, with their cases too if cases is set
+bool FrameWriter::open(const char *path, MarchingSquaresEngine &engine, unsigned int seed, bool cases) {
+	close();
+
+	file = fopen(path, "wb");
+	if (file == NULL) {
+		return false;
+	}
+
+	this->cases = cases;
+	mode = engine.getClassificationMode();
+	lastBalls.clear();
+	frames = 0;
+	bytes = 0;
+	buffer.reserve(RECORDING_BUFFER_BYTES);
+
+	RecordingHeader header;
+	memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+	header.version = RECORDING_VERSION;
+	header.dimension = engine.getDimension();
+	header.squareWidth = engine.getSquareWidth();
+	header.mode = mode;
+	header.seed = seed;
+	append(&header, sizeof(header));
+
+	return true;
+}
+
+// Records the balls engine last classified with, and the cases that came out, after classify or step
+void FrameWriter::writeFrame(MarchingSquaresEngine &engine) {
+	if (file == NULL) {
+		return;
+	}
+
+	if ((unsigned int)engine.getClassificationMode() != mode) {
+		mode = engine.getClassificationMode();
+		appendTag(RECORD_MODE, mode);
+	}
+
+	BallStore &balls = engine.getBalls();
+	bool changed = frames == 0 || balls.size() != lastBalls.size();
+
+	for (unsigned int i = 0; i < balls.size() && !changed; i++) {
+		vec4 color = balls.getColor(i);
+		const BallRecord &last = lastBalls[i];
+
+		changed = balls.getRadius(i) != last.radius || memcmp(&color, &last.color, sizeof(vec4)) != 0;
+	}
+
+	if (changed) {
+		lastBalls.resize(balls.size());
+
+		for (unsigned int i = 0; i < balls.size(); i++) {
+			lastBalls[i] = BallRecord{ balls.getX(i), balls.getY(i), balls.getRadius(i), balls.getColor(i) };
+		}
+
+		appendTag(RECORD_BALLS, (unsigned int)lastBalls.size());
+		append(lastBalls.data(), lastBalls.size() * sizeof(BallRecord));
+	} else {
+		appendTag(RECORD_POSITIONS, (unsigned int)balls.size());
+
+		for (unsigned int i = 0; i < balls.size(); i++) {
+			PositionRecord record = { balls.getX(i), balls.getY(i) };
+			append(&record, sizeof(record));
+		}
+	}
+
+	if (cases) {
+		std::vector<int> squares = engine.getActiveSquares().getSquares();
+		std::sort(squares.begin(), squares.end());
+		frameCases.resize(squares.size());
+
+		for (unsigned int i = 0; i < squares.size(); i++) {
+			// Zeroing the padding so recordings of the same run compare equal byte for byte
+			memset(&frameCases[i], 0, sizeof(CaseRecord));
+			frameCases[i].square = squares[i];
+			frameCases[i].state = (unsigned char)engine.getState(squares[i]);
+			frameCases[i].color = engine.getColorIndex(squares[i]);
+		}
+
+		appendTag(RECORD_CASES, (unsigned int)frameCases.size());
+		append(frameCases.data(), frameCases.size() * sizeof(CaseRecord));
+	}
+
+	frames++;
+}
+
+// Writes out what's left in the buffer, returning false if any write failed
+bool FrameWriter::close() {
+	if (file == NULL) {
+		return true;
+	}
+
+	flush();
+
+	bool written = ferror(file) == 0;
+	written = fclose(file) == 0 && written;
+	file = NULL;
+
+	return written;
+}
+
+void FrameWriter::append(const void *data, size_t size) {
+	const unsigned char *bytes = static_cast<const unsigned char*>(data);
+
+	// Large records skip the buffer once it has been emptied
+	if (buffer.size() + size > RECORDING_BUFFER_BYTES) {
+		flush();
+
+		if (size > RECORDING_BUFFER_BYTES) {
+			fwrite(bytes, 1, size, file);
+			this->bytes += size;
+			return;
+		}
+	}
+
+	buffer.insert(buffer.end(), bytes, bytes + size);
+	this->bytes += size;
+}
+
+void FrameWriter::appendTag(RecordType type, unsigned int count) {
+	RecordTag tag = { (unsigned int)type, count };
+	append(&tag, sizeof(tag));
+}
+
+void FrameWriter::flush() {
+	if (!buffer.empty()) {
+		fwrite(buffer.data(), 1, buffer.size(), file);
+		buffer.clear();
+	}
+}
+
+size_t FrameWriter::getFrames() {
+	return frames;
+}
+
+size_t FrameWriter::getBytes() {
+	return bytes;
+}
+
+//////////////////////
+// class: FrameReader
+//////////////////
+
+FrameReader::FrameReader() {
+	fd = -1;
+	data = NULL;
+	length = 0;
+	at = 0;
+	cases = NULL;
+	caseCount = 0;
+	frames = 0;
+	error = NULL;
+	memset(&header, 0, sizeof(header));
+}
+
+FrameReader::~FrameReader() {
+	close();
+}
+
+// Maps a recording and checks its header, returning false and setting the error on failure
+bool FrameReader::open(const char *path) {
+	close();
+
+	fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		error = "can't open file";
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(RecordingHeader)) {
+		error = "too short to be a recording";
+		close();
+		return false;
+	}
+
+	length = (size_t)info.st_size;
+	void *mapped = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+
+	if (mapped == MAP_FAILED) {
+		error = "mmap failed";
+		length = 0;
+		close();
+		return false;
+	}
+
+	data = static_cast<const unsigned char*>(mapped);
+	madvise(mapped, length, MADV_SEQUENTIAL);
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)) != 0 || header.version != RECORDING_VERSION) {
+		error = "not a recording, or from another version";
+		close();
+		return false;
+	}
+
+	rewind();
+
+	return true;
+}
+
+void FrameReader::close() {
+	if (data != NULL) {
+		munmap(const_cast<unsigned char*>(data), length);
+	}
+
+	if (fd >= 0) {
+		::close(fd);
+	}
+
+	fd = -1;
+	data = NULL;
+	length = 0;
+	at = 0;
+	cases = NULL;
+	caseCount = 0;
+}
+
+// Goes back to the first frame
+void FrameReader::rewind() {
+	at = sizeof(RecordingHeader);
+	cases = NULL;
+	caseCount = 0;
+	frames = 0;
+}
+
+// Loads the next frame's mode and balls into engine, false once the recording
+// ends or turns out to be cut short. Full ball records replace the engine's
+// balls, position records move the ones already there.
+bool FrameReader::nextFrame(MarchingSquaresEngine &engine) {
+	bool started = false;
+
+	cases = NULL;
+	caseCount = 0;
+
+	while (at + sizeof(RecordTag) <= length) {
+		RecordTag tag;
+		memcpy(&tag, data + at, sizeof(tag));
+
+		// The next frame's balls end this one
+		if (started && (tag.type == RECORD_BALLS || tag.type == RECORD_POSITIONS)) {
+			break;
+		}
+
+		at += sizeof(tag);
+
+		if (tag.type == RECORD_MODE) {
+			engine.setClassificationMode(static_cast<ClassificationMode>(tag.count));
+		} else if (tag.type == RECORD_BALLS) {
+			const BallRecord *records = static_cast<const BallRecord*>(take(tag.count * sizeof(BallRecord)));
+			if (records == NULL) {
+				return false;
+			}
+
+			BallStore &balls = engine.getBalls();
+			balls.clear();
+			balls.reserve(tag.count);
+
+			for (unsigned int i = 0; i < tag.count; i++) {
+				balls.add(Ball(records[i].radius, 0.0f, vec3{ records[i].x, records[i].y, BALL_DEPTH },
+					vec3{ 1.0f, 1.0f, 0.0f }, records[i].color));
+			}
+
+			started = true;
+		} else if (tag.type == RECORD_POSITIONS) {
+			const PositionRecord *records = static_cast<const PositionRecord*>(take(tag.count * sizeof(PositionRecord)));
+			BallStore &balls = engine.getBalls();
+
+			if (records == NULL || tag.count != balls.size()) {
+				error = records == NULL ? error : "positions for a different number of balls";
+				return false;
+			}
+
+			for (unsigned int i = 0; i < tag.count; i++) {
+				balls.setPosition(i, vec3{ records[i].x, records[i].y, BALL_DEPTH });
+			}
+
+			started = true;
+		} else if (tag.type == RECORD_CASES) {
+			cases = static_cast<const CaseRecord*>(take(tag.count * sizeof(CaseRecord)));
+			if (cases == NULL) {
+				return false;
+			}
+
+			caseCount = tag.count;
+		} else {
+			error = "unknown record";
+			return false;
+		}
+	}
+
+	if (started) {
+		frames++;
+	}
+
+	return started;
+}
+
+// Points at size bytes of the file and steps past them, NULL if the file ends first
+const void* FrameReader::take(size_t size) {
+	if (size > length - at) {
+		error = "recording is cut short";
+		return NULL;
+	}
+
+	const void *record = data + at;
+	at += size;
+
+	return record;
+}
+
+// Cases recorded with the frame last loaded, NULL if it has none
+const CaseRecord* FrameReader::getCases(size_t &count) {
+	count = caseCount;
+	return cases;
+}
+
+const RecordingHeader& FrameReader::getHeader() {
+	return header;
+}
+
+size_t FrameReader::getFrames() {
+	return frames;
+}
+
+const char* FrameReader::getError() {
+	return error;
+}
@@ -0,0 +1,123 @@
+/*
+	Marching Squares - Frame Recording
+	Compact binary recordings of the balls each frame was classified with,
+	and optionally the cases it produced, so a run can be replayed exactly.
+*/
+
+#ifndef FRAME_RECORDING_H
+#define FRAME_RECORDING_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <vector>
+
+#include "marchingSquaresEngine.h"
+
+// Everything is stored in the byte order of the machine that recorded it
+const char RECORDING_MAGIC[4] = { 'M', 'S', 'Q', 'R' };
+const unsigned int RECORDING_VERSION = 1;
+const size_t RECORDING_BUFFER_BYTES = 1 << 20;
+
+typedef struct RecordingHeader {
+	char magic[4];
+	unsigned int version;
+	float dimension;
+	float squareWidth;
+	unsigned int mode;
+	// Seed the recorded run was started with, for reference only
+	unsigned int seed;
+} RecordingHeader;
+
+typedef enum RecordType {
+	// Every ball's position, radius and color, starting a frame
+	RECORD_BALLS,
+	// Only positions, starting a frame whose balls match the last full record otherwise
+	RECORD_POSITIONS,
+	// The frame's non-empty squares in square order
+	RECORD_CASES,
+	// Classification mode from this frame on, held in count
+	RECORD_MODE
+} RecordType;
+
+// Precedes count entries of the record's type
+typedef struct RecordTag {
+	unsigned int type;
+	unsigned int count;
+} RecordTag;
+
+typedef struct BallRecord {
+	float x;
+	float y;
+	float radius;
+	vec4 color;
+} BallRecord;
+
+typedef struct PositionRecord {
+	float x;
+	float y;
+} PositionRecord;
+
+typedef struct CaseRecord {
+	int square;
+	unsigned char state;
+	unsigned char color;
+} CaseRecord;
+
+// Appends frames into a buffer that is written out a megabyte at a time.
+// A frame's balls are stored in full only when their count, radii or colors
+// changed since the last full record, positions alone otherwise.
+class FrameWriter {
+	private:
+		FILE *file;
+		std::vector<unsigned char> buffer;
+		bool cases;
+		unsigned int mode;
+		std::vector<BallRecord> lastBalls;
+		std::vector<CaseRecord> frameCases;
+		size_t frames;
+		size_t bytes;
+
+		void append(const void *data, size_t size);
+		void appendTag(RecordType type, unsigned int count);
+		void flush();
+
+	public:
+		FrameWriter();
+		~FrameWriter();
+		bool open(const char *path, MarchingSquaresEngine &engine, unsigned int seed, bool cases);
+		void writeFrame(MarchingSquaresEngine &engine);
+		bool close();
+		size_t getFrames();
+		size_t getBytes();
+};
+
+// Maps a whole recording and walks it frame by frame, loading each frame's
+// balls into an engine without copying the file.
+class FrameReader {
+	private:
+		int fd;
+		const unsigned char *data;
+		size_t length;
+		size_t at;
+		RecordingHeader header;
+		const CaseRecord *cases;
+		size_t caseCount;
+		size_t frames;
+		const char *error;
+
+		const void* take(size_t size);
+
+	public:
+		FrameReader();
+		~FrameReader();
+		bool open(const char *path);
+		void close();
+		void rewind();
+		bool nextFrame(MarchingSquaresEngine &engine);
+		const CaseRecord* getCases(size_t &count);
+		const RecordingHeader& getHeader();
+		size_t getFrames();
+		const char* getError();
+};
+
+#endif
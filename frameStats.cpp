@@ -0,0 +1,135 @@
+/*
+	Marching Squares - Frame Stats
+	Per-stage timings and counters for one frame, and a writer streaming them
+	frame by frame to CSV or JSON.
+*/
+
+#include <string.h>
+
+#include "frameStats.h"
+
+const char *STAGE_NAMES[STAGE_COUNT] = { "move", "bounds", "collide", "locate", "classify", "mesh", "submit" };
+
+void clearFrameStats(FrameStats &stats) {
+	memset(&stats, 0, sizeof(FrameStats));
+}
+
+void addFrameStats(FrameStats &totals, const FrameStats &stats) {
+	for (int s = 0; s < STAGE_COUNT; s++) {
+		totals.stageMs[s] += stats.stageMs[s];
+	}
+
+	totals.activeSquares += stats.activeSquares;
+	totals.duplicates += stats.duplicates;
+	totals.triangles += stats.triangles;
+	totals.balls += stats.balls;
+}
+
+bool parseStatsFormat(const char *name, StatsFormat &format) {
+	if (strcmp(name, "csv") == 0) {
+		format = STATS_CSV;
+	} else if (strcmp(name, "json") == 0) {
+		format = STATS_JSON;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+//////////////////////
+// class: StatsWriter
+//////////////////
+
+StatsWriter::StatsWriter() {
+	file = NULL;
+	format = STATS_CSV;
+	frames = 0;
+	clearFrameStats(totals);
+}
+
+StatsWriter::~StatsWriter() {
+	close();
+}
+
+bool StatsWriter::open(const char *path, StatsFormat format) {
+	close();
+
+	file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+
+	this->format = format;
+	frames = 0;
+	clearFrameStats(totals);
+
+	if (format == STATS_CSV) {
+		fprintf(file, "frame");
+
+		for (int s = 0; s < STAGE_COUNT; s++) {
+			fprintf(file, ",%s_ms", STAGE_NAMES[s]);
+		}
+
+		fprintf(file, ",active_squares,duplicates,triangles,balls\n");
+	} else {
+		fprintf(file, "[");
+	}
+
+	return true;
+}
+
+// Frame numbers are the caller's, so frames that were skipped show up as gaps
+void StatsWriter::writeFrame(unsigned long long frame, const FrameStats &stats) {
+	if (file == NULL) {
+		return;
+	}
+
+	if (format == STATS_CSV) {
+		fprintf(file, "%llu", frame);
+
+		for (int s = 0; s < STAGE_COUNT; s++) {
+			fprintf(file, ",%.4f", stats.stageMs[s]);
+		}
+
+		fprintf(file, ",%zu,%zu,%zu,%zu\n", stats.activeSquares, stats.duplicates, stats.triangles, stats.balls);
+	} else {
+		fprintf(file, "%s\n{\"frame\":%llu", frames == 0 ? "" : ",", frame);
+
+		for (int s = 0; s < STAGE_COUNT; s++) {
+			fprintf(file, ",\"%s_ms\":%.4f", STAGE_NAMES[s], stats.stageMs[s]);
+		}
+
+		fprintf(file, ",\"active_squares\":%zu,\"duplicates\":%zu,\"triangles\":%zu,\"balls\":%zu}",
+			stats.activeSquares, stats.duplicates, stats.triangles, stats.balls);
+	}
+
+	addFrameStats(totals, stats);
+	frames++;
+}
+
+// Closes the JSON array if there is one, returning false if any write failed
+bool StatsWriter::close() {
+	if (file == NULL) {
+		return true;
+	}
+
+	if (format == STATS_JSON) {
+		fprintf(file, "\n]\n");
+	}
+
+	bool written = ferror(file) == 0;
+	written = fclose(file) == 0 && written;
+	file = NULL;
+
+	return written;
+}
+
+size_t StatsWriter::getFrames() {
+	return frames;
+}
+
+// Sums over every frame written since open
+const FrameStats& StatsWriter::getTotals() {
+	return totals;
+}
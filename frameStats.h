@@ -0,0 +1,112 @@
+/*
+	Marching Squares - Frame Stats
+	Per-stage timings and counters for one frame, and a writer streaming them
+	frame by frame to CSV or JSON.
+*/
+
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <chrono>
+
+#include "tracer.h"
+
+typedef enum FrameStage {
+	// Moving every ball and testing it against the walls, one vector pass
+	STAGE_MOVE,
+	// Turning the balls that crossed a wall
+	STAGE_BOUNDS,
+	// Separating balls that touch
+	STAGE_COLLIDE,
+	// Finding the square under each ball's center
+	STAGE_LOCATE,
+	// Setting the cases of the squares the balls reach
+	STAGE_CLASSIFY,
+	// Building the frame's mesh from the active squares
+	STAGE_MESH,
+	// Handing the mesh to GL, or copying it out in headless runs
+	STAGE_SUBMIT,
+	STAGE_COUNT
+} FrameStage;
+
+extern const char *STAGE_NAMES[STAGE_COUNT];
+
+// Each field is set by the stage that produces it, stages that didn't run leave zeros
+typedef struct FrameStats {
+	double stageMs[STAGE_COUNT];
+	size_t activeSquares;
+	// Inserts into the active set this frame for squares already in it
+	size_t duplicates;
+	size_t triangles;
+	size_t balls;
+} FrameStats;
+
+// Sets a stage's time to how long the timer ran, from construction to stop or
+// destruction, and records it as a trace event named after the stage while
+// tracing. With neither a timer never reads a clock.
+class StageTimer {
+	private:
+		double *stageMs;
+		FrameStage stage;
+		std::chrono::steady_clock::time_point start;
+		long long traceStart;
+
+	public:
+		StageTimer(FrameStats &stats, FrameStage stage, bool enabled) : stageMs(enabled ? &stats.stageMs[stage] : NULL), stage(stage) {
+			if (stageMs != NULL) {
+				start = std::chrono::steady_clock::now();
+			}
+
+			traceStart = isTracing() ? traceClock() : -1;
+		}
+
+		~StageTimer() {
+			stop();
+		}
+
+		void stop() {
+			if (stageMs != NULL) {
+				*stageMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				stageMs = NULL;
+			}
+
+			if (traceStart >= 0) {
+				recordTraceEvent(STAGE_NAMES[stage], traceStart, TRACE_NO_ARG);
+				traceStart = -1;
+			}
+		}
+};
+
+typedef enum StatsFormat {
+	// A header row, then one row per frame
+	STATS_CSV,
+	// An array holding one object per frame
+	STATS_JSON
+} StatsFormat;
+
+// Writes one frame at a time so long runs never hold their stats in memory,
+// keeping running totals for a summary at the end
+class StatsWriter {
+	private:
+		FILE *file;
+		StatsFormat format;
+		size_t frames;
+		FrameStats totals;
+
+	public:
+		StatsWriter();
+		~StatsWriter();
+		bool open(const char *path, StatsFormat format);
+		void writeFrame(unsigned long long frame, const FrameStats &stats);
+		bool close();
+		size_t getFrames();
+		const FrameStats& getTotals();
+};
+
+void clearFrameStats(FrameStats &stats);
+void addFrameStats(FrameStats &totals, const FrameStats &stats);
+bool parseStatsFormat(const char *name, StatsFormat &format);
+
+#endif
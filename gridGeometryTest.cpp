@@ -0,0 +1,58 @@
+/*
+	Marching Squares - Grid Geometry Test
+	Builds grids the way the command line tools do, a dimension of
+	(n - 1) * width / 2 for --grid n, and checks each comes out exactly n
+	squares a side, including widths that aren't powers of two. Grids wider
+	than MAX_GRID_SIDE must be refused. Exits with 1 on the first mismatch.
+
+	Usage: gridGeometryTest
+*/
+
+#include <stdio.h>
+
+#include "marchingSquaresEngine.h"
+
+const float WIDTHS[] = { 0.3f, 0.7f, 1.3f, 0.1f, 0.9f, 3.7f, 0.25f, 1.0f, 2.0f };
+const int WIDTH_COUNT = sizeof(WIDTHS) / sizeof(WIDTHS[0]);
+const int SIZES[] = { 2, 3, 7, 100, 101, 999, 1024, 4097, 12345, MAX_GRID_SIDE };
+const int SIZE_COUNT = sizeof(SIZES) / sizeof(SIZES[0]);
+
+int main(int argc, char *argv[]) {
+	if (argc > 1) {
+		fprintf(stderr, "Usage: %s\n", argv[0]);
+		return 1;
+	}
+
+	int grids = 0;
+
+	for (int w = 0; w < WIDTH_COUNT; w++) {
+		for (int s = 0; s < SIZE_COUNT; s++) {
+			float width = WIDTHS[w];
+			int size = SIZES[s];
+			MarchingSquaresEngine engine((size - 1) * width / 2.0f, width);
+
+			// Only the tiles are allocated up front, so the largest grids stay cheap
+			engine.setSparseGrid(true);
+
+			if (!engine.populateGrid() || engine.getRows() != size || engine.getCols() != size) {
+				printf("width %g, grid %d: built %dx%d\n", width, size, engine.getRows(), engine.getCols());
+				return 1;
+			}
+
+			grids++;
+		}
+
+		MarchingSquaresEngine tooWide(MAX_GRID_SIDE * WIDTHS[w] / 2.0f, WIDTHS[w]);
+		tooWide.setSparseGrid(true);
+
+		if (tooWide.populateGrid()) {
+			printf("width %g, grid %d: built %dx%d past MAX_GRID_SIDE\n", WIDTHS[w], MAX_GRID_SIDE + 1,
+				tooWide.getRows(), tooWide.getCols());
+			return 1;
+		}
+	}
+
+	printf("grids: %d, every one the size asked for\n", grids);
+
+	return 0;
+}
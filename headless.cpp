@@ -0,0 +1,433 @@
+/*
+	Marching Squares - Headless
+	Runs the engine without a window and reports frames per second. Runs can
+	be recorded to a file and replayed later, optionally checking every frame's
+	cases against the recorded ones. Pipelined runs step and build meshes on a
+	producer thread while the main thread takes the latest frames, as the viewer does.
+	Stage timings and counters can be streamed to CSV or JSON, one entry per frame,
+	and the whole run traced to Chrome trace-event JSON.
+
+	Usage: headless [--frames N] [--grid N] [--width W] [--balls N] [--radius MIN[:MAX]] [--seed N] [--mode corners|occupancy|metaball] [--kernel scalar|sse2|avx2] [--threads N] [--incremental] [--moving N] [--sparse] [--adaptive] [--collide] [--record FILE] [--record-cases] [--replay FILE] [--verify] [--pipelined] [--stats FILE] [--stats-format csv|json] [--trace FILE]
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctime>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "frameProducer.h"
+#include "frameRecording.h"
+#include "frameStats.h"
+#include "tracer.h"
+#include "marchingSquaresEngine.h"
+
+/////////////////////////
+// Default Settings
+/////////////////////
+
+const int DEFAULT_FRAMES = 1000;
+const int DEFAULT_BALLS = 8;
+const unsigned long long CHECKSUM_BASIS = 14695981039346656037ULL;
+const unsigned long long CHECKSUM_PRIME = 1099511628211ULL;
+
+int replay(const char *path, bool verify, KernelLevel kernelLevel, unsigned int threads, bool incremental, bool sparse, bool adaptive);
+unsigned long long checksumCases(MarchingSquaresEngine &engine, unsigned long long checksum);
+void printStatsSummary(StatsWriter &statsWriter);
+bool finishTrace(const char *path);
+void printUsage(const char *program);
+
+///////////
+// main()
+///////
+
+int main(int argc, char *argv[]) {
+	int frames = DEFAULT_FRAMES;
+	int balls = DEFAULT_BALLS;
+	// Squares per side, the viewer's grid is 2 * DIMENSION / SQUARE_WIDTH + 1
+	int gridSize = (int)(2.0f * DIMENSION / SQUARE_WIDTH) + 1;
+	float squareWidth = SQUARE_WIDTH;
+	// Zero picks radii from the grid's extent, as the viewer does
+	int minRadius = 0;
+	int maxRadius = 0;
+	unsigned int seed = static_cast<unsigned int>(time(0));
+	ClassificationMode mode = CORNER_TESTS;
+	KernelLevel kernelLevel = KERNEL_AVX2;
+	// One classifies serially, zero uses every core
+	unsigned int threads = 1;
+	bool incremental = false;
+	bool sparse = false;
+	bool adaptive = false;
+	bool collide = false;
+	// Balls left moving, the rest stay put, negative moves them all
+	int moving = -1;
+	const char *recordName = NULL;
+	bool recordCases = false;
+	const char *replayName = NULL;
+	bool verify = false;
+	bool pipelined = false;
+	const char *statsName = NULL;
+	StatsFormat statsFormat = STATS_CSV;
+	const char *traceName = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frames = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+			gridSize = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+			squareWidth = (float)atof(argv[++i]);
+		} else if (strcmp(argv[i], "--balls") == 0 && i + 1 < argc) {
+			balls = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--radius") == 0 && i + 1 < argc) {
+			if (!parseRadiusRange(argv[++i], minRadius, maxRadius)) {
+				printUsage(argv[0]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			seed = static_cast<unsigned int>(strtoul(argv[++i], NULL, 10));
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = static_cast<unsigned int>(strtoul(argv[++i], NULL, 10));
+		} else if (strcmp(argv[i], "--incremental") == 0) {
+			incremental = true;
+		} else if (strcmp(argv[i], "--sparse") == 0) {
+			sparse = true;
+		} else if (strcmp(argv[i], "--adaptive") == 0) {
+			adaptive = true;
+		} else if (strcmp(argv[i], "--collide") == 0) {
+			collide = true;
+		} else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			recordName = argv[++i];
+		} else if (strcmp(argv[i], "--record-cases") == 0) {
+			recordCases = true;
+		} else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			replayName = argv[++i];
+		} else if (strcmp(argv[i], "--verify") == 0) {
+			verify = true;
+		} else if (strcmp(argv[i], "--pipelined") == 0) {
+			pipelined = true;
+		} else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+			statsName = argv[++i];
+		} else if (strcmp(argv[i], "--stats-format") == 0 && i + 1 < argc) {
+			if (!parseStatsFormat(argv[++i], statsFormat)) {
+				printUsage(argv[0]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			traceName = argv[++i];
+		} else if (strcmp(argv[i], "--moving") == 0 && i + 1 < argc) {
+			moving = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+			if (!parseKernelLevel(argv[++i], kernelLevel)) {
+				printUsage(argv[0]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+			if (!parseClassificationMode(argv[++i], mode)) {
+				printUsage(argv[0]);
+				return 1;
+			}
+		} else {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (frames <= 0 || gridSize < 2 || gridSize > MAX_GRID_SIDE || !(squareWidth > 0.0f) || balls < 0 || (verify && replayName == NULL) ||
+		(pipelined && (recordName != NULL || replayName != NULL)) || (statsName != NULL && replayName != NULL)) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	nameTraceThread("main");
+
+	if (traceName != NULL) {
+		startTracing();
+	}
+
+	if (replayName != NULL) {
+		int status = replay(replayName, verify, kernelLevel, threads, incremental, sparse, adaptive);
+		return finishTrace(traceName) ? status : 1;
+	}
+
+	srand(seed);
+
+	// Grid spans [-dimension, dimension] on both axes
+	MarchingSquaresEngine engine((gridSize - 1) * squareWidth / 2.0f, squareWidth);
+	engine.setClassificationMode(mode);
+	engine.setKernelLevel(kernelLevel);
+	engine.setThreadCount(threads);
+	engine.setIncremental(incremental);
+	engine.setSparseGrid(sparse);
+	engine.setAdaptive(adaptive);
+	engine.setCollisions(collide);
+	engine.setStatsEnabled(statsName != NULL);
+
+	if (!engine.populateGrid()) {
+		fprintf(stderr, "headless: grid is wider than %d squares\n", MAX_GRID_SIDE);
+		return 1;
+	}
+
+	if (maxRadius > 0) {
+		engine.generateShapes(balls, minRadius, maxRadius);
+	} else {
+		engine.generateShapes(balls);
+	}
+
+	for (int i = moving < 0 ? balls : moving; i < balls; i++) {
+		engine.getBalls().setSpeed(i, 0.0f);
+	}
+
+	FrameWriter writer;
+	unsigned long long checksum = CHECKSUM_BASIS;
+
+	if (recordName != NULL && !writer.open(recordName, engine, seed, recordCases)) {
+		fprintf(stderr, "headless: can't open %s\n", recordName);
+		return 1;
+	}
+
+	StatsWriter statsWriter;
+
+	if (statsName != NULL && !statsWriter.open(statsName, statsFormat)) {
+		fprintf(stderr, "headless: can't open %s\n", statsName);
+		return 1;
+	}
+
+	long long deltas = 0;
+	FrameProducer producer(engine);
+	// Stands in for the vertex buffer a renderer would upload each taken frame to
+	std::vector<MeshVertex> upload;
+	long long taken = 0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	if (pipelined) {
+		// The producer stops itself after exactly frames steps
+		producer.start(0.0, frames);
+
+		while (producer.getProduced() < (unsigned long long)frames) {
+			if (producer.acquire()) {
+				ProducedFrame &frame = producer.getFrame();
+				const std::vector<MeshVertex> &triangles = frame.mesh.getTriangles();
+
+				StageTimer submitTimer(frame.stats, STAGE_SUBMIT, statsName != NULL);
+				upload.assign(triangles.begin(), triangles.end());
+				submitTimer.stop();
+
+				// Only frames the render side takes are written, the rest show up as gaps
+				statsWriter.writeFrame(frame.sequence, frame.stats);
+				taken++;
+			} else {
+				std::this_thread::yield();
+			}
+		}
+
+		producer.stop();
+	} else {
+		for (int i = 0; i < frames; i++) {
+			engine.step();
+			deltas += engine.getDeltas().size();
+			statsWriter.writeFrame(i + 1, engine.getStats());
+
+			if (recordName != NULL) {
+				writer.writeFrame(engine);
+				checksum = checksumCases(engine, checksum);
+			}
+		}
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	if (recordName != NULL && !writer.close()) {
+		fprintf(stderr, "headless: writing %s failed\n", recordName);
+		return 1;
+	}
+
+	if (statsName != NULL && !statsWriter.close()) {
+		fprintf(stderr, "headless: writing %s failed\n", statsName);
+		return 1;
+	}
+
+	if (!finishTrace(traceName)) {
+		return 1;
+	}
+
+	printf("grid: %dx%d (%.1f MB), square width: %g, balls: %d, seed: %u\n", engine.getRows(), engine.getCols(),
+		engine.getGridBytes() / (1024.0 * 1024.0), squareWidth, balls, seed);
+	printf("kernels: %s, threads: %u, incremental: %s, sparse: %s, adaptive: %s\n", engine.getKernels().name,
+		engine.getThreadCount(), incremental ? "yes" : "no", sparse ? "yes" : "no", adaptive ? "yes" : "no");
+	printf("frames: %d, seconds: %.3f, fps: %.1f\n", frames, elapsed.count(), frames / elapsed.count());
+
+	if (collide) {
+		printf("collisions, last frame: %zu pairs tested, %zu touching\n", engine.getBalls().getPairTests(),
+			engine.getBalls().getContacts());
+	}
+
+	if (pipelined) {
+		printf("pipelined: %lld of %d frames taken by the render side, %zu vertices in the last\n", taken, frames,
+			upload.size());
+	} else if (incremental) {
+		printf("changed squares per frame: %.1f\n", (double)deltas / frames);
+	}
+
+	if (recordName != NULL) {
+		printf("recorded: %zu frames, %.1f KB, cases checksum: %016llx\n", writer.getFrames(),
+			writer.getBytes() / 1024.0, checksum);
+	}
+
+	if (statsName != NULL) {
+		printStatsSummary(statsWriter);
+	}
+
+	return 0;
+}
+
+// Classifies every frame of a recording, timing only the classification,
+// and with verify set compares each frame's cases to the recorded ones
+int replay(const char *path, bool verify, KernelLevel kernelLevel, unsigned int threads, bool incremental, bool sparse, bool adaptive) {
+	FrameReader reader;
+
+	if (!reader.open(path)) {
+		fprintf(stderr, "headless: %s: %s\n", path, reader.getError());
+		return 1;
+	}
+
+	const RecordingHeader &header = reader.getHeader();
+
+	MarchingSquaresEngine engine(header.dimension, header.squareWidth);
+	engine.setClassificationMode(static_cast<ClassificationMode>(header.mode));
+	engine.setKernelLevel(kernelLevel);
+	engine.setThreadCount(threads);
+	engine.setIncremental(incremental);
+	engine.setSparseGrid(sparse);
+	engine.setAdaptive(adaptive);
+
+	if (!engine.populateGrid()) {
+		fprintf(stderr, "headless: %s: grid is wider than %d squares\n", path, MAX_GRID_SIDE);
+		return 1;
+	}
+
+	unsigned long long checksum = CHECKSUM_BASIS;
+	long long mismatches = 0;
+	long long uncheckedFrames = 0;
+	std::chrono::duration<double> elapsed(0.0);
+
+	while (reader.nextFrame(engine)) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		engine.classify();
+		elapsed += std::chrono::steady_clock::now() - start;
+
+		checksum = checksumCases(engine, checksum);
+
+		if (!verify) {
+			continue;
+		}
+
+		size_t caseCount = 0;
+		const CaseRecord *cases = reader.getCases(caseCount);
+
+		if (cases == NULL) {
+			uncheckedFrames++;
+			continue;
+		}
+
+		std::vector<int> squares = engine.getActiveSquares().getSquares();
+		std::sort(squares.begin(), squares.end());
+
+		// Squares only one side has count once each
+		size_t i = 0;
+		size_t j = 0;
+
+		while (i < squares.size() || j < caseCount) {
+			if (j == caseCount || (i < squares.size() && squares[i] < cases[j].square)) {
+				i++;
+				mismatches++;
+			} else if (i == squares.size() || cases[j].square < squares[i]) {
+				j++;
+				mismatches++;
+			} else {
+				if (engine.getState(squares[i]) != cases[j].state || engine.getColorIndex(squares[i]) != cases[j].color) {
+					mismatches++;
+				}
+
+				i++;
+				j++;
+			}
+		}
+	}
+
+	if (reader.getError() != NULL) {
+		fprintf(stderr, "headless: %s: %s\n", path, reader.getError());
+		return 1;
+	}
+
+	size_t frames = reader.getFrames();
+
+	printf("grid: %dx%d, balls: %zu, seed: %u, replayed from %s\n", engine.getRows(), engine.getCols(),
+		engine.getBalls().size(), header.seed, path);
+	printf("kernels: %s, threads: %u, incremental: %s, sparse: %s, adaptive: %s\n", engine.getKernels().name,
+		engine.getThreadCount(), incremental ? "yes" : "no", sparse ? "yes" : "no", adaptive ? "yes" : "no");
+	printf("frames: %zu, seconds: %.3f, fps: %.1f\n", frames, elapsed.count(), frames / elapsed.count());
+	printf("cases checksum: %016llx\n", checksum);
+
+	if (verify) {
+		printf("mismatched squares: %lld, frames without recorded cases: %lld\n", mismatches, uncheckedFrames);
+	}
+
+	return mismatches == 0 ? 0 : 2;
+}
+
+// Folds the active squares, their states and colors into an FNV-1a checksum
+unsigned long long checksumCases(MarchingSquaresEngine &engine, unsigned long long checksum) {
+	std::vector<int> squares = engine.getActiveSquares().getSquares();
+	std::sort(squares.begin(), squares.end());
+
+	for (unsigned int i = 0; i < squares.size(); i++) {
+		unsigned int values[3] = { (unsigned int)squares[i], (unsigned int)engine.getState(squares[i]),
+			engine.getColorIndex(squares[i]) };
+
+		for (unsigned int j = 0; j < 3; j++) {
+			checksum = (checksum ^ values[j]) * CHECKSUM_PRIME;
+		}
+	}
+
+	return checksum;
+}
+
+// Averages over the frames written to the stats file
+void printStatsSummary(StatsWriter &statsWriter) {
+	const FrameStats &totals = statsWriter.getTotals();
+	double frames = statsWriter.getFrames() > 0 ? (double)statsWriter.getFrames() : 1.0;
+
+	printf("stats: %zu frames, ms per frame:", statsWriter.getFrames());
+
+	for (int s = 0; s < STAGE_COUNT; s++) {
+		printf(" %s %.4f", STAGE_NAMES[s], totals.stageMs[s] / frames);
+	}
+
+	printf("\nper frame: %.1f active squares, %.1f duplicate activations, %.1f triangles, %.1f balls\n",
+		totals.activeSquares / frames, totals.duplicates / frames, totals.triangles / frames, totals.balls / frames);
+}
+
+// Stops tracing and writes the trace, if one was asked for
+bool finishTrace(const char *path) {
+	if (path == NULL) {
+		return true;
+	}
+
+	stopTracing();
+
+	if (!writeTrace(path)) {
+		fprintf(stderr, "headless: writing %s failed\n", path);
+		return false;
+	}
+
+	return true;
+}
+
+void printUsage(const char *program) {
+	fprintf(stderr, "Usage: %s [--frames N] [--grid N] [--width W] [--balls N] [--radius MIN[:MAX]] [--seed N] [--mode corners|occupancy|metaball] [--kernel scalar|sse2|avx2] [--threads N] [--incremental] [--moving N] [--sparse] [--adaptive] [--collide] [--record FILE] [--record-cases] [--replay FILE] [--verify] [--pipelined] [--stats FILE] [--stats-format csv|json] [--trace FILE]\n", program);
+}
@@ -0,0 +1,252 @@
+/*
+	Marching Squares - Mapped Raster
+	Read only memory map of a raster file, raw or with a PGM or PFM header,
+	handing out rows straight from the mapped pages.
+*/
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mappedRaster.h"
+
+// Headers are a few short lines, anything longer isn't one
+const size_t MAX_HEADER_BYTES = 256;
+
+// Reads the next whitespace separated header token, skipping # comments
+static bool readToken(const unsigned char *data, size_t length, size_t &at, char *token, size_t size) {
+	while (at < length && (isspace(data[at]) || data[at] == '#')) {
+		if (data[at] == '#') {
+			while (at < length && data[at] != '\n') {
+				at++;
+			}
+		} else {
+			at++;
+		}
+	}
+
+	size_t count = 0;
+
+	while (at < length && !isspace(data[at]) && count + 1 < size) {
+		token[count++] = (char)data[at++];
+	}
+
+	token[count] = '\0';
+
+	return count > 0 && at < length;
+}
+
+///////////////////////
+// class: MappedRaster
+///////////////////
+
+MappedRaster::MappedRaster() {
+	fd = -1;
+	data = NULL;
+	length = 0;
+	offset = 0;
+	width = 0;
+	height = 0;
+	type = RASTER_UINT8;
+	bottomUp = false;
+	error = NULL;
+}
+
+MappedRaster::~MappedRaster() {
+	close();
+}
+
+// Maps path, taking the size and sample type from its header if it has one,
+// otherwise from width and type. Returns false and sets the error on failure.
+bool MappedRaster::open(const char *path, int width, RasterType type) {
+	close();
+
+	fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		error = "can't open file";
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		error = "can't map an empty file";
+		close();
+		return false;
+	}
+
+	length = (size_t)info.st_size;
+	void *mapped = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+
+	if (mapped == MAP_FAILED) {
+		error = "mmap failed";
+		length = 0;
+		close();
+		return false;
+	}
+
+	data = static_cast<const unsigned char*>(mapped);
+	this->width = width;
+	this->type = type;
+
+	int headerWidth = 0;
+	long long headerHeight = 0;
+
+	if (length >= 2 && data[0] == 'P' && (data[1] == '5' || data[1] == 'f' || data[1] == 'F')) {
+		if (!parseHeader(headerWidth, headerHeight)) {
+			close();
+			return false;
+		}
+
+		this->width = headerWidth;
+	} else if (width < 2) {
+		error = "raw rasters need a width";
+		close();
+		return false;
+	}
+
+	long long rows = (long long)((length - offset) / getRowBytes());
+	height = headerHeight > 0 ? headerHeight : rows;
+
+	if (height > rows) {
+		error = "file is shorter than its header says";
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+// Reads a binary PGM (P5) or grayscale PFM (Pf) header, leaving offset at the first row
+bool MappedRaster::parseHeader(int &headerWidth, long long &headerHeight) {
+	char token[32];
+	size_t at = 2;
+	bool pfm = data[1] != '5';
+
+	if (data[1] == 'F') {
+		error = "color PFM files aren't supported";
+		return false;
+	}
+
+	if (!readToken(data, length, at, token, sizeof(token))) {
+		error = "bad header";
+		return false;
+	}
+	headerWidth = atoi(token);
+
+	if (!readToken(data, length, at, token, sizeof(token))) {
+		error = "bad header";
+		return false;
+	}
+	headerHeight = atoll(token);
+
+	if (!readToken(data, length, at, token, sizeof(token)) || at >= MAX_HEADER_BYTES) {
+		error = "bad header";
+		return false;
+	}
+
+	if (pfm) {
+		// A negative scale marks little endian samples
+		float scale = (float)atof(token);
+		unsigned int probe = 1;
+		bool littleHost = *reinterpret_cast<unsigned char*>(&probe) == 1;
+
+		if ((scale < 0.0f) != littleHost) {
+			error = "PFM byte order doesn't match this machine";
+			return false;
+		}
+
+		type = RASTER_FLOAT32;
+		bottomUp = true;
+	} else {
+		if (atoi(token) > 255) {
+			error = "16 bit PGM files aren't supported";
+			return false;
+		}
+
+		type = RASTER_UINT8;
+	}
+
+	if (headerWidth < 2 || headerHeight < 1) {
+		error = "bad header size";
+		return false;
+	}
+
+	// One whitespace byte ends the header
+	offset = at + 1;
+
+	return true;
+}
+
+void MappedRaster::close() {
+	if (data != NULL) {
+		munmap(const_cast<unsigned char*>(data), length);
+	}
+
+	if (fd >= 0) {
+		::close(fd);
+	}
+
+	fd = -1;
+	data = NULL;
+	length = 0;
+	offset = 0;
+	height = 0;
+	bottomUp = false;
+}
+
+// Row row counted from the top, straight from the mapped pages
+const void* MappedRaster::getRow(long long row) {
+	long long stored = bottomUp ? height - 1 - row : row;
+	return data + offset + stored * getRowBytes();
+}
+
+// True when float rows can be read in place, otherwise they need copying out first
+bool MappedRaster::isAligned() {
+	return type != RASTER_FLOAT32 || offset % sizeof(float) == 0;
+}
+
+// For a single pass over the whole file, reading ahead aggressively and dropping pages behind
+void MappedRaster::adviseSequential() {
+	madvise(const_cast<unsigned char*>(data), length, MADV_SEQUENTIAL);
+}
+
+// Asks for rows first to last, inclusive, to be read in ahead of use
+void MappedRaster::adviseRows(long long first, long long last) {
+	if (bottomUp) {
+		long long flipped = height - 1 - last;
+		last = height - 1 - first;
+		first = flipped;
+	}
+
+	// madvise wants a page aligned start
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t start = offset + first * getRowBytes();
+	size_t end = offset + (last + 1) * getRowBytes();
+	size_t aligned = start - start % page;
+
+	madvise(const_cast<unsigned char*>(data) + aligned, end - aligned, MADV_WILLNEED);
+}
+
+int MappedRaster::getWidth() {
+	return width;
+}
+
+long long MappedRaster::getHeight() {
+	return height;
+}
+
+RasterType MappedRaster::getType() {
+	return type;
+}
+
+size_t MappedRaster::getRowBytes() {
+	return width * rasterSampleBytes(type);
+}
+
+const char* MappedRaster::getError() {
+	return error;
+}
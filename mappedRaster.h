@@ -0,0 +1,48 @@
+/*
+	Marching Squares - Mapped Raster
+	Read only memory map of a raster file, raw or with a PGM or PFM header,
+	handing out rows straight from the mapped pages.
+*/
+
+#ifndef MAPPED_RASTER_H
+#define MAPPED_RASTER_H
+
+#include <stddef.h>
+
+#include "scanlineContour.h"
+
+// The file is mapped shared, so every process contouring it reads the same
+// page cache and nothing is loaded up front. Rows are numbered top down,
+// PFM files store theirs bottom up and are flipped on the way out.
+class MappedRaster {
+	private:
+		int fd;
+		const unsigned char *data;
+		size_t length;
+		// Bytes of header before the first row
+		size_t offset;
+		int width;
+		long long height;
+		RasterType type;
+		bool bottomUp;
+		const char *error;
+
+		bool parseHeader(int &headerWidth, long long &headerHeight);
+
+	public:
+		MappedRaster();
+		~MappedRaster();
+		bool open(const char *path, int width, RasterType type);
+		void close();
+		const void* getRow(long long row);
+		bool isAligned();
+		void adviseSequential();
+		void adviseRows(long long first, long long last);
+		int getWidth();
+		long long getHeight();
+		RasterType getType();
+		size_t getRowBytes();
+		const char* getError();
+};
+
+#endif
@@ -5,177 +5,54 @@
 */
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
 #include <math.h>
 #include <ctime>
+#include <chrono>
+#include <thread>
 #include <vector>
-#include <queue>
 
 #ifdef __APPLE__
 	#include <OpenGL/gl.h>
 	#include <OpenGL/glu.h>
 	#include <GLUT/glut.h>
 #elif __linux__
+	// Instancing needs GL 2.1 and ARB_instanced_arrays entry points, linked directly here
+	#define GL_GLEXT_PROTOTYPES
 	#include <GL/gl.h>
+	#include <GL/glext.h>
 	#include <GLUT/glut.h>
+	#define INSTANCING_AVAILABLE 1
 #elif _WIN32
 	#include <GLUT/glut.h>
 #endif
 
-#ifndef PI
-	#define PI 3.14159265358979323846
+#ifndef INSTANCING_AVAILABLE
+	#define INSTANCING_AVAILABLE 0
 #endif
 
+#include "frameProducer.h"
+#include "frameStats.h"
+#include "marchingSquaresEngine.h"
+#include "meshBuilder.h"
+#include "tracer.h"
+
 /////////////////////////
-// Scene & Window Const
+// Window Const
 /////////////////////
 
+// Defaults, overridden by --window
 const GLint WIDTH = 800;
 const GLint HEIGHT = 800;
-const GLfloat ASPECT = (GLfloat)WIDTH / (GLfloat)HEIGHT;
 const GLfloat FOV = 70.0f;
 
-const GLfloat DIMENSION = 100;
-const GLfloat SQUARE_WIDTH = 2.0f;
-const GLfloat VIEW_SCALAR = (FOV / (100.0f * DIMENSION));
-
-//////////////////////////////
-// Vector Maths Declarations
-//////////////////////////
+const int DEFAULT_BALLS = 8;
 
-typedef struct vec3 {
-	GLfloat x;
-	GLfloat y;
-	GLfloat z;
-} vec3;
-
-typedef struct vec4 {
-	GLfloat x;
-	GLfloat y;
-	GLfloat z;
-	GLfloat w;
-} vec4;
-
-GLfloat magnitude(const vec3 &vec);
-vec3 normalize(const vec3 &vec);
-vec3 cross(const vec3 &u, const vec3 &v);
-vec3 operator/(const vec3 &vec, const GLfloat &scalar);
-vec3 operator*(const vec3 &vec, const GLfloat &scalar);
-vec3 operator+(const vec3 &u, const vec3 &v);
-vec3 operator-(const vec3 &u, const vec3 &v);
-
-//////////////////////////////////
-// Marching Squares Declarations
-//////////////////////////////
-
-typedef enum Direction {
-	NE,
-	N,
-	NW,
-	W,
-	SW,
-	S,
-	SE,
-	E
-} Direction;
-
-typedef enum MarchingSquareState {
-	EMPTY,
-	TOP_LEFT,
-	BOT_LEFT,
-	LEFT,
-	BOT_RIGHT,
-	NEG_DIAG,
-	BOTTOM,
-	INV_TOP_RIGHT,
-	TOP_RIGHT,
-	UPPER,
-	POS_DIAG,
-	INV_BOT_RIGHT,
-	RIGHT,
-	INV_BOT_LEFT,
-	INV_TOP_LEFT,
-	FILLED
-} MarchingSquareState;
-
-class Ball {
-	private:
-		GLfloat radius;
-		GLfloat speed;
-		vec3 position;
-		vec3 facing;
-		vec4 color;
-		bool outOfBounds;
-
-	public:
-		Ball(GLfloat radius, GLfloat speed = 3.0f, vec3 position = vec3{ 0.0f, 0.0f, 0.0f },
-			vec3 facing = vec3{ 1.0f, 1.0f, 0.0f }, vec4 color = vec4{ 1.0f, 1.0f, 1.0f });
-		bool contains(vec3 point);
-		void move();
-		void bounce(const vec3 &normal);
-		GLfloat getRadius();
-		vec3 getPosition();
-		vec3 getFacing();
-		vec4 getColor();
-		bool isOutOfBounds();
-		void setOutOfBounds();
-		void clearOutOfBounds();
-};
-
-class MarchingSquare {
-	private:
-		/*
-		*  p3----p2
-		*  |      |
-		*  |      |
-		*  p0----p1
-		*/
-		vec3 p0;
-		vec3 p1;
-		vec3 p2;
-		vec3 p3;
-		vec3 center;
-		vec4 color;
-		int row;
-		int col;
-		MarchingSquareState state;
-	
-	public:
-		MarchingSquare(int row, int col, vec3 p0, 
-						vec4 color = vec4{ 0.2f, 0.29f, 0.82f, 1.0f }, 
-						MarchingSquareState state = EMPTY);
-		bool contains(vec3 point);
-		void activate(const vec4 &color, MarchingSquareState state);
-		void emptyState();
-		vec3 getPosition();
-		vec3 botLeft();
-		vec3 botRight();
-		vec3 topRight();
-		vec3 getCenter();
-		vec4 getColor();
-		MarchingSquareState getState();
-		int getRow();
-		int getCol();
-};
-
-class SceneBounds {
-	private:
-		GLfloat maxX;
-		GLfloat minX;
-		GLfloat maxY;
-		GLfloat minY;
-
-	public:
-		SceneBounds(GLfloat maxX, GLfloat minX, GLfloat maxY, GLfloat minY);
-		bool outOfBounds(Ball &ball);
-		vec3 getWallNormal(Ball &ball);
-};
-
-MarchingSquare* findSquare(const vec3 &pos);
-void resolveSquareStates(Ball &ball, MarchingSquare &square);
-void activateSquare(MarchingSquare &square, Ball &ball, int state);
-Direction generateDirection();
-void populateGrid();
-void generateShapes(int numShapes);
+// Stats overlay text, in pixels from the window's top left corner
+const int HUD_MARGIN = 10;
+const int HUD_LINE_HEIGHT = 15;
 
 ////////////////////////
 // OpenGL Declarations
@@ -196,283 +73,169 @@ typedef struct Camera {
 	vec3 up;
 } Camera;
 
+#if INSTANCING_AVAILABLE
+// The 16 case templates live on the GPU, each frame only sends instance records
+typedef struct CaseRenderer {
+	GLuint program;
+	GLuint templateBuffer;
+	GLuint instanceBuffer;
+	GLint positionAttrib;
+	GLint cellAttrib;
+	GLint colorAttrib;
+	GLint gridUniform;
+	GLint scaleUniform;
+	int first[CASE_COUNT];
+	int count[CASE_COUNT];
+} CaseRenderer;
+
+GLuint compileShader(GLenum type, const char *source);
+bool initInstancing();
+void drawInstancedSquares(ProducedFrame &frame);
+#endif
+
 void initOpenGL();
 void resetProjection();
 void resizeViewport(GLint width, GLint height);
 void draw();
+void drawHud(ProducedFrame &frame);
 void driver();
 
+unsigned int overlayFlags();
 void keyboardHandler(unsigned char key, int x, int y);
-
-//////////////////
-// Lookup Tables
-//////////////
-
-std::vector<std::vector<GLfloat> > squareStateLookup {
-	// EMPTY for consistency
-	{},
-	// TOP_LEFT
-	{ -0.1f, 1.0f, -1.0f,
-	-1.0f, 1.0f, -1.0f,
-	-1.0f, 0.1f, -1.0f },
-
-	// BOT_LEFT
-	{ -1.0f, -1.0f, -1.0f,
-	-0.1f, -1.0f, -1.0f,
-	-1.0f, -0.1f, -1.0f },
-
-	// LEFT
-	{ -1.0f, -1.0f, -1.0f,
-	-0.1f, -1.0f, -1.0f,
-	-1.0f, 0.0f, -1.0f,
-
-	-0.1f, -1.0f, -1.0f,
-	-0.1f, 1.0f, -1.0f,
-	-1.0f, 0.0f, -1.0f,
-
-	-1.0f, 0.0f, -1.0f,
-	-1.0f, 1.0f, -1.0f,
-	-0.1f, 1.0f, -1.0f },
-
-	// BOT_RIGHT
-	{ 0.1f, -1.0f, -1.0f,
-	1.0f, -1.0f, -1.0f,
-	1.0f, -0.1f, -1.0f },
-
-	// NEG_DIAG
-	{ 0.1f, -1.0f, -1.0f,
-	1.0f, -1.0f, -1.0f,
-	1.0f, -0.1f, -1.0f,
-
-	-0.1f, 1.0f, -1.0f,
-	-1.0f, 1.0f, -1.0f,
-	-1.0f, 0.1f, -1.0f,
-
-	-1.0f, 0.1f, -1.0f,
-	0.1f, -1.0f, -1.0f,
-	1.0f, -0.1f, -1.0f,
-
-	1.0f, -0.1f, -1.0f,
-	-0.1f, 1.0f, -1.0f,
-	-1.0f, 0.1f, -1.0f },
-
-	// BOTTOM
-	{ 0.0f, -1.0f, -1.0f,
-	1.0f, -1.0f, -1.0f,
-	1.0f, -0.1f, -1.0f,
-
-	1.0f, -0.1f, -1.0f,
-	-1.0f, -0.1f, -1.0f,
-	0.0f, -1.0f, -1.0f,
-
-	-1.0f, -0.1f, -1.0f,
-	-1.0f, -1.0f, -1.0f,
-	0.0f, -1.0f, -1.0f },
-
-	// INV_TOP_RIGHT
-	{ -1.0f, -1.0f, -1.0f,
-	-0.1f, -1.0f, -1.0f,
-	-1.0f, -0.1f, -1.0f,
-
-	-0.1f, -1.0f, -1.0f,
-	1.0f, -1.0f, -1.0f,
-	1.0f, 0.1f, -1.0f,
-
-	-0.1f, -1.0f, -1.0f,
-	1.0f, 0.1f, -1.0f,
-	-1.0f, -0.1f, -1.0f,
-
-	-1.0f, -0.1f, -1.0f,
-	1.0f, 0.1f, -1.0f,
-	0.1f, 1.0f, -1.0f,
-
-	0.1f, 1.0f, -1.0f,
-	-1.0f, 1.0f, -1.0f,
-	-1.0f, -0.1f, -1.0f },
-
-	// TOP_RIGHT
-	{ 1.0f, 0.1f, -1.0f,
-	1.0f, 1.0f, -1.0f,
-	0.1f, 1.0f, -1.0f },
-
-	// UPPER
-	{ 0.0f, 1.0f, -1.0f,
-	-1.0f, 1.0f, -1.0f,
-	-1.0f, 0.1f, -1.0f,
-
-	-1.0f, 0.1f, -1.0f,
-	1.0f, 0.1f, -1.0f,
-	0.0f, 1.0f, -1.0f,
-
-	1.0f, 0.1f, -1.0f,
-	1.0f, 1.0f, -1.0f,
-	0.0f, 1.0f, -1.0f },
-
-	// POS_DIAG
-	{ -1.0f, -1.0f, -1.0f,
-	-0.1f, -1.0f, -1.0f,
-	-1.0f, -0.1f, -1.0f,
-
-	-0.1f, -1.0f, -1.0f,
-	1.0f, 0.1f, -1.0f,
-	-1.0f, -0.1f, -1.0f,
-
-	-1.0f, -0.1f, -1.0f,
-	0.1f, 1.0f, -1.0f,
-	1.0f, 0.1f, -1.0f,
-
-	1.0f, 0.1f, -1.0f,
-	1.0f, 1.0f, -1.0f,
-	0.1f, 1.0f, -1.0f },
-
-	// INV_BOT_RIGHT
-	{ 1.0f, 1.0f, -1.0f,
-	-0.1f, 1.0f, -1.0f,
-	1.0f, -0.1f, -1.0f,
-
-	-0.1f, 1.0f, -1.0f,
-	-1.0f, 1.0f, -1.0f,
-	-1.0f, 0.1f, -1.0f,
-
-	-1.0f, 0.1f, -1.0f,
-	-1.0f, -1.0f, -1.0f,
-	0.1f, -1.0f, -1.0f,
-
-	0.1f, -1.0f, -1.0f,
-	1.0f, -0.1f, -1.0f,
-	-1.0f, 0.1f, -1.0f,
-
-	-1.0f, 0.1f, -1.0f,
-	-0.1f, 1.0f, -1.0f,
-	1.0f, -0.1f, -1.0f },
-
-	// RIGHT
-	{ 1.0f, 1.0f, -1.0f,
-	0.1f, 1.0f, -1.0f,
-	1.0f, 0.0f, -1.0f,
-
-	0.1f, 1.0f, -1.0f,
-	0.1f, -1.0f, -1.0f,
-	1.0f, 0.0f, -1.0f,
-
-	1.0f, 0.0f, -1.0f,
-	1.0f, -1.0f, -1.0f,
-	0.1f, -1.0f, -1.0f },
-
-	// INV_BOT_LEFT
-	{ 1.0f, 1.0f, -1.0f,
-	0.1f, 1.0f, -1.0f,
-	1.0f, 0.1f, -1.0f,
-
-	0.1f, 1.0f, -1.0f,
-	-1.0f, 1.0f, -1.0f,
-	-1.0f, -0.1f, -1.0f,
-
-	0.1f, 1.0f, -1.0f,
-	-1.0f, -0.1f, -1.0f,
-	1.0f, 0.1f, -1.0f,
-
-	1.0f, 0.1f, -1.0f,
-	-1.0f, -0.1f, -1.0f,
-	-0.1f, -1.0f, -1.0f,
-
-	-0.1f, -1.0f, -1.0f,
-	1.0f, -1.0f, -1.0f,
-	1.0f, 0.1f, -1.0f },
-
-	// INV_TOP_LEFT
-	{ -1.0f, -1.0f, -1.0f,
-	0.1f, -1.0f, -1.0f,
-	-1.0f, 0.1f, -1.0f,
-
-	0.1f, -1.0f, -1.0f,
-	1.0f, -1.0f, -1.0f,
-	1.0f, -0.1f, -1.0f,
-
-	1.0f, -0.1f, -1.0f,
-	1.0f, 1.0f, -1.0f,
-	-0.1f, 1.0f, -1.0f,
-
-	-0.1f, 1.0f, -1.0f,
-	-1.0f, 0.1f, -1.0f,
-	1.0f, -0.1f, -1.0f,
-
-	1.0f, -0.1f, -1.0f,
-	0.1f, -1.0f, -1.0f,
-	-1.0f, 0.1f, -1.0f },
-
-	// FILLED
-	{ 0.0f, 1.0f, -1.0f,
-	-1.0f, 1.0f, -1.0f,
-	-1.0f, 0.0f, -1.0f,
-
-	-1.0f, 0.0f, -1.0f,
-	1.0f, 0.0f, -1.0f,
-	0.0f, 1.0f, -1.0f,
-
-	1.0f, 0.0f, -1.0f,
-	1.0f, 1.0f, -1.0f,
-	0.0f, 1.0f, -1.0f,
-
-	0.0f, -1.0f, -1.0f,
-	1.0f, -1.0f, -1.0f,
-	1.0f, -0.0f, -1.0f,
-
-	1.0f, -0.0f, -1.0f,
-	-1.0f, -0.0f, -1.0f,
-	0.0f, -1.0f, -1.0f,
-
-	-1.0f, -0.0f, -1.0f,
-	-1.0f, -1.0f, -1.0f,
-	0.0f, -1.0f, -1.0f }
-};
-
-vec3 directionsLookup[]{
-	vec3{ 1.0f, 1.0f, 0.0f },
-	vec3{ 0.0f, 1.0f, 0.0f },
-	vec3{ -1.0f, 1.0f, 0.0f },
-	vec3{ -1.0f, 0.0f, 0.0f },
-	vec3{ -1.0f, -1.0f, 0.0f },
-	vec3{ 0.0f, -1.0f, 0.0f },
-	vec3{ 1.0f, -1.0f, 0.0f },
-	vec3{ 1.0f, 0.0f, 0.0f }
-};
+void printUsage(const char *program);
 
 ////////////
 // Globals
 ////////
 
-std::vector<std::vector<MarchingSquare> > grid;
-std::queue<MarchingSquare*> activeSquares;
-std::vector<Ball> balls;
+MarchingSquaresEngine engine;
+// Owns the engine from startup on, callbacks only read its published frames
+FrameProducer producer(engine);
 
-Camera camera = { vec3{ 0.0f, 0.0f, 1.0f }, vec3{ 0.0f, 0.0f, 0.0f }, vec3{ 0.0f, 1.0f, 0.0f } };
-SceneBounds sceneBounds(DIMENSION, -1.0f * DIMENSION + 4.0f, DIMENSION - 4.0f, -1.0f * DIMENSION);
+GLint windowWidth = WIDTH;
+GLint windowHeight = HEIGHT;
+GLfloat aspect = (GLfloat)WIDTH / (GLfloat)HEIGHT;
+// Fits the grid to the view, set once the grid's extent is known
+GLfloat viewScalar = FOV / (100.0f * DIMENSION);
 
-MarchingSquare nullSqr(-1.0f, -1.0f, vec3{ 0.0f, 0.0f, 0.0f });
-MarchingSquare *centerSquare;
+Camera camera = { vec3{ 0.0f, 0.0f, 1.0f }, vec3{ 0.0f, 0.0f, 0.0f }, vec3{ 0.0f, 1.0f, 0.0f } };
 
 bool activeSqrsEnabled = false;
 bool centerSqrEnabled = false;
 bool shapesEnabled = false;
+bool hudEnabled = false;
+// Written on exit when set
+const char *traceName = NULL;
+bool instancingSupported = false;
+MeshKind renderMode = MESH_BATCHED;
+
+#if INSTANCING_AVAILABLE
+CaseRenderer caseRenderer;
+
+// Scales a case template to half a square width and offsets it to its square from the instance's column and row
+const char *CASE_VERTEX_SHADER =
+	"#version 120\n"
+	"attribute vec3 position;\n"
+	"attribute vec2 cell;\n"
+	"attribute vec4 color;\n"
+	"uniform vec2 grid;\n"
+	"uniform float scale;\n"
+	"varying vec4 squareColor;\n"
+	"void main() {\n"
+	"	vec3 topLeft = vec3(cell.x * grid.x - grid.y, grid.y - cell.y * grid.x, -1.0);\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * vec4(vec3(position.xy * scale, position.z) + topLeft, 1.0);\n"
+	"	squareColor = color;\n"
+	"}\n";
+
+const char *CASE_FRAGMENT_SHADER =
+	"#version 120\n"
+	"varying vec4 squareColor;\n"
+	"void main() {\n"
+	"	gl_FragColor = squareColor;\n"
+	"}\n";
+#endif
 
 ///////////
 // main()
 ///////
 
+// Usage: marchingSquares [--grid N] [--width W] [--balls N] [--radius MIN[:MAX]] [--window WxH] [--rate N] [--collide] [--trace FILE]
 int main(int argc, char *argv[]) {
 	GLint window;
+	// Squares per side, zero keeps the default extent whatever the width
+	int gridSize = 0;
+	float squareWidth = SQUARE_WIDTH;
+	int balls = DEFAULT_BALLS;
+	// Zero picks radii from the grid's extent
+	int minRadius = 0;
+	int maxRadius = 0;
+	// Simulation steps per second, zero steps as fast as the producer can
+	double stepRate = DEFAULT_STEP_RATE;
+	bool collide = false;
 
 	srand(static_cast<unsigned int>(time(0)));
 
+	// GLUT takes its own options out of argv first
+	glutInit(&argc, argv);
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+			gridSize = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+			squareWidth = (float)atof(argv[++i]);
+		} else if (strcmp(argv[i], "--balls") == 0 && i + 1 < argc) {
+			balls = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--radius") == 0 && i + 1 < argc) {
+			if (!parseRadiusRange(argv[++i], minRadius, maxRadius)) {
+				printUsage(argv[0]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &windowWidth, &windowHeight) != 2 || windowWidth < 1 || windowHeight < 1) {
+				printUsage(argv[0]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+			stepRate = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--collide") == 0) {
+			collide = true;
+		} else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			traceName = argv[++i];
+		} else {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!(squareWidth > 0.0f) || (gridSize != 0 && (gridSize < 2 || gridSize > MAX_GRID_SIDE)) || balls < 0 || !(stepRate >= 0.0)) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	// Grid spans [-dimension, dimension] on both axes
+	float dimension = gridSize != 0 ? (gridSize - 1) * squareWidth / 2.0f : DIMENSION;
+
+	aspect = (GLfloat)windowWidth / (GLfloat)windowHeight;
+	viewScalar = FOV / (100.0f * dimension);
+
 	// Initializing scene state
-	populateGrid();
-	generateShapes(8);
+	engine.setGeometry(dimension, squareWidth);
+	engine.setCollisions(collide);
+
+	if (!engine.populateGrid()) {
+		fprintf(stderr, "Grid is wider than %d squares\n", MAX_GRID_SIDE);
+		return 1;
+	}
+
+	if (maxRadius > 0) {
+		engine.generateShapes(balls, minRadius, maxRadius);
+	} else {
+		engine.generateShapes(balls);
+	}
 
 	// Initializing window
-	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_ALPHA | GLUT_DEPTH);
-	glutInitWindowSize(WIDTH, HEIGHT);
+	glutInitWindowSize(windowWidth, windowHeight);
 	glutInitWindowPosition(0, 0);
 	window = glutCreateWindow("Marching Squares");
 
@@ -487,6 +250,16 @@ int main(int argc, char *argv[]) {
 	// Initializing OpenGL
 	initOpenGL();
 
+	nameTraceThread("render");
+
+	if (traceName != NULL) {
+		startTracing();
+	}
+
+	// Simulating and building meshes from here on happens on the producer's thread
+	producer.setMeshKind(renderMode);
+	producer.start(stepRate);
+
 	glutMainLoop();
 }
 
@@ -511,6 +284,12 @@ void initOpenGL() {
 	gluLookAt(camera.position.x, camera.position.y, camera.position.z,
 		camera.facing.x, camera.facing.y, camera.facing.z,
 		camera.up.x, camera.up.y, camera.up.z);
+
+#if INSTANCING_AVAILABLE
+	// Falling back to the batched vertex array when the driver can't instance
+	instancingSupported = initInstancing();
+	renderMode = instancingSupported ? MESH_INSTANCED : MESH_BATCHED;
+#endif
 }
 
 // Resets projection matrix to initial values
@@ -518,7 +297,7 @@ void resetProjection() {
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
 
-	gluPerspective(FOV, ASPECT, 0.1, 10.0f);
+	gluPerspective(FOV, aspect, 0.1, 10.0f);
 }
 
 // Adjust OpenGL state on window resize
@@ -530,6 +309,8 @@ void resizeViewport(GLint width, GLint height) {
 
 	// Setting viewport to new window size
 	glViewport(0, 0, width, height);
+	windowWidth = width;
+	windowHeight = height;
 
 	// Preparing projection matrix
 	resetProjection();
@@ -544,631 +325,366 @@ void resizeViewport(GLint width, GLint height) {
 		camera.up.x, camera.up.y, camera.up.z);
 }
 
-// Main "loop" since GLUT is event driven
+// Main "loop" since GLUT is event driven, drawing whenever the producer
+// has published a frame. Frame N is drawn while frame N+1 is being built.
 void driver() {
-	// Looking for out of bounds shapes
-	for (unsigned int i = 0; i < balls.size(); i++) {
-		balls.at(i).move();
-
-		// Reorienting shapes if out of bounds
-		if (!balls.at(i).isOutOfBounds() && sceneBounds.outOfBounds(balls.at(i))) {
-			balls.at(i).setOutOfBounds();
-			// Generating new facing from wall normal
-			balls.at(i).bounce(sceneBounds.getWallNormal(balls.at(i)));
-		} else if(balls.at(i).isOutOfBounds()) {
-			// Clearing out of bounds flag once shapes return to scene
-			balls.at(i).clearOutOfBounds();
-		}
-	}
-
-	for (unsigned int j = 0; j < balls.size(); j++) {
-		// Searching for squares containing centers of shapes
-		MarchingSquare *epicenter = findSquare(balls.at(j).getPosition());
-		
-		if (epicenter != &nullSqr) {
-			centerSquare = epicenter;
-			// Testing vertices of intersected squares and setting state
-			resolveSquareStates(balls.at(j), *epicenter);
-		}
+	if (producer.acquire()) {
+		TraceScope trace("draw");
+		draw();
+	} else {
+		// Leaving the core to the producer until it has something new
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
 	}
-
-	draw();
 }
 
+// Draws the frame last taken from the producer, which leaves it alone until the next acquire
 void draw() {
-	std::vector<GLfloat> *verts;
-	std::vector<GLfloat>::iterator vertIter;
-
-	std::vector<Ball> *shapeVerts;
-	std::vector<Ball>::iterator shapeIter;
+	ProducedFrame &frame = producer.getFrame();
+	MeshBuilder &mesh = frame.mesh;
 
-	MarchingSquare *square;
+	// The front slot is the render thread's, so submit time goes in with the producer's stats
+	StageTimer submitTimer(frame.stats, STAGE_SUBMIT, hudEnabled);
 
 	// Clearing color and depth buffers
 	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	while (!activeSquares.empty()) {
-		// Grabbing next active square object
-		square = activeSquares.front();
-		activeSquares.pop();
+	// Vertices are already in grid space, one transform covers the whole frame
+	glPushMatrix();
+	glScalef(viewScalar, viewScalar, viewScalar);
 
-		// Grabbing next block of vertices
-		verts = &squareStateLookup.at(square->getState());
+#if INSTANCING_AVAILABLE
+	if (frame.kind == MESH_INSTANCED) {
+		drawInstancedSquares(frame);
+	}
+#endif
 
-		// Vertex data attributes
-		unsigned int vertexDataSize = 3;
-		unsigned int locationBegin = 0;
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
 
-		// Applying transformations
-		glPushMatrix();
-		glScalef(VIEW_SCALAR, VIEW_SCALAR, VIEW_SCALAR);
-		glTranslatef(square->getPosition().x, square->getPosition().y, square->getPosition().z);
+	const std::vector<MeshVertex> &triangles = mesh.getTriangles();
+	const std::vector<MeshVertex> &lines = mesh.getLines();
+	const std::vector<MeshVertex> &welded = mesh.getWeldedVertices();
+	const std::vector<unsigned int> &indices = mesh.getIndices();
 
-		// Pushing mesh slightly backward to prevent z-fighting with overlay
+	if (!indices.empty()) {
 		glPolygonOffset(1.0f, 1.0f);
 		glEnable(GL_POLYGON_OFFSET_FILL);
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-		// Begin rendering
-		glBegin(GL_TRIANGLES);
+		// Drawing the welded mesh, each shared point stored once
+		glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), &welded[0].x);
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(MeshVertex), welded[0].color);
+		glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, &indices[0]);
 
-		// Drawing marching squares
-		for (vertIter = verts->begin(); vertIter < verts->end(); vertIter += vertexDataSize) {
-			glColor4f(square->getColor().x, square->getColor().y, square->getColor().z, square->getColor().w);
-			glVertex3f(*vertIter, *(vertIter + 1), *(vertIter + 2));
-		}
+		glDisable(GL_POLYGON_OFFSET_FILL);
+	}
+
+	if (!triangles.empty()) {
+		// Pushing mesh slightly backward to prevent z-fighting with overlay
+		glPolygonOffset(1.0f, 1.0f);
+		glEnable(GL_POLYGON_OFFSET_FILL);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-		glEnd();
+		// Drawing marching squares
+		glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), &triangles[0].x);
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(MeshVertex), triangles[0].color);
+		glDrawArrays(GL_TRIANGLES, 0, (GLsizei)triangles.size());
 
 		glDisable(GL_POLYGON_OFFSET_FILL);
+	}
 
-		glPopMatrix();
+	if (!lines.empty()) {
+		// Drawing square, epicenter and ball outlines
+		glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), &lines[0].x);
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(MeshVertex), lines[0].color);
+		glDrawArrays(GL_LINES, 0, (GLsizei)lines.size());
+	}
 
-		if (activeSqrsEnabled) {
-			// Drawing active square outlines
-			glPushMatrix();
-			glScalef(VIEW_SCALAR, VIEW_SCALAR, VIEW_SCALAR);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
 
-			// Bringing outline forward so no z-fighting with mesh
-			glPolygonOffset(-1.0f, -1.0f);
-			glEnable(GL_POLYGON_OFFSET_LINE);
-			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	glPopMatrix();
 
-			glBegin(GL_POLYGON);
+	submitTimer.stop();
 
-			glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-			glVertex3f(square->getPosition().x, square->getPosition().y, square->getPosition().z);
-			glVertex3f(square->botLeft().x, square->botLeft().y, square->botLeft().z);
-			glVertex3f(square->botRight().x, square->botRight().y, square->botRight().z);
-			glVertex3f(square->topRight().x, square->topRight().y, square->topRight().z);
+	if (hudEnabled) {
+		drawHud(frame);
+	}
 
-			glEnd();
-			glDisable(GL_POLYGON_OFFSET_LINE);
-			glPopMatrix();
-		}
+	// Blocks here when the driver syncs to the display
+	TraceScope trace("swap");
+	glutSwapBuffers();
+}
 
-		// Clearing shape state
-		square->emptyState();
-	}
+// Writes the frame's stage times and counters over the top left corner of the window
+void drawHud(ProducedFrame &frame) {
+	const FrameStats &stats = frame.stats;
+	char lines[STAGE_COUNT + 3][64];
+	int lineCount = 0;
 
-	if (shapesEnabled) {
-		for (shapeIter = balls.begin(); shapeIter < balls.end(); shapeIter++) {
-			// Applying transformations
-			glPushMatrix();
-			glScalef(VIEW_SCALAR, VIEW_SCALAR, VIEW_SCALAR);
-
-			glPolygonOffset(-1.0f, -1.0f);
-			glEnable(GL_POLYGON_OFFSET_LINE);
-			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-
-			glBegin(GL_POLYGON);
-
-			// Drawing circle outline
-			glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-			glVertex3f((*shapeIter).getPosition().x + (*shapeIter).getRadius(), (*shapeIter).getPosition().y, 0.0f);
-			for (GLfloat theta = 0; theta < 2 * PI; theta += PI / 12.0)
-			{
-				glVertex3f((*shapeIter).getPosition().x + cos(theta) * (*shapeIter).getRadius(),
-					(*shapeIter).getPosition().y + sin(theta) * (*shapeIter).getRadius(), 0.0f);
-			}
+	snprintf(lines[lineCount++], sizeof(lines[0]), "frame %llu", frame.sequence);
 
-			glEnd();
-			glDisable(GL_POLYGON_OFFSET_LINE);
-			glPopMatrix();
-		}
+	for (int s = 0; s < STAGE_COUNT; s++) {
+		snprintf(lines[lineCount++], sizeof(lines[0]), "%-9s%8.3f ms", STAGE_NAMES[s], stats.stageMs[s]);
 	}
 
-	if (centerSqrEnabled) {
-		// Applying transformations
-		glPushMatrix();
-		glScalef(VIEW_SCALAR, VIEW_SCALAR, VIEW_SCALAR);
+	snprintf(lines[lineCount++], sizeof(lines[0]), "active %zu, duplicates %zu", stats.activeSquares, stats.duplicates);
+	snprintf(lines[lineCount++], sizeof(lines[0]), "triangles %zu, balls %zu", stats.triangles, stats.balls);
 
-		glPolygonOffset(-1.0f, -1.0f);
-		glEnable(GL_POLYGON_OFFSET_LINE);
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	// Drawing in window pixels, over everything else
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	gluOrtho2D(0.0, windowWidth, 0.0, windowHeight);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	glDisable(GL_DEPTH_TEST);
 
-		glBegin(GL_POLYGON);
+	glColor3f(0.9f, 0.9f, 0.9f);
 
-		// Note: This only works for the square most recently returned by findSquare()
-		// Drawing epicenter outline
-		glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-		glVertex3f(centerSquare->getPosition().x, centerSquare->getPosition().y, centerSquare->getPosition().z);
-		glVertex3f(centerSquare->botLeft().x, centerSquare->botLeft().y, centerSquare->botLeft().z);
-		glVertex3f(centerSquare->botRight().x, centerSquare->botRight().y, centerSquare->botRight().z);
-		glVertex3f(centerSquare->topRight().x, centerSquare->topRight().y, centerSquare->topRight().z);
+	for (int l = 0; l < lineCount; l++) {
+		glRasterPos2i(HUD_MARGIN, windowHeight - HUD_MARGIN - (l + 1) * HUD_LINE_HEIGHT);
 
-		glEnd();
-		glDisable(GL_POLYGON_OFFSET_LINE);
-		glPopMatrix();
+		for (const char *c = lines[l]; *c != '\0'; c++) {
+			glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *c);
+		}
 	}
 
-	glutSwapBuffers();
+	glEnable(GL_DEPTH_TEST);
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+}
+
+// Outlines the producer adds to each frame
+unsigned int overlayFlags() {
+	return (activeSqrsEnabled ? OVERLAY_SQUARES : 0) | (centerSqrEnabled ? OVERLAY_CENTER : 0) |
+		(shapesEnabled ? OVERLAY_BALLS : 0);
 }
 
+// Engine changes are posted to the producer, which runs them between frames
 void keyboardHandler(unsigned char key, int x, int y) {
 	switch (key) {
 		// Exit program if escape key pressed
 		case 27:
+			producer.stop();
+
+			if (traceName != NULL && !writeTrace(traceName)) {
+				fprintf(stderr, "Writing %s failed\n", traceName);
+			}
+
 			exit(0);
 			break;
 		case 'a':
 			activeSqrsEnabled = !activeSqrsEnabled;
+			producer.setOverlays(overlayFlags());
 			break;
 		case 's':
 			centerSqrEnabled = !centerSqrEnabled;
+			producer.setOverlays(overlayFlags());
 			break;
 		case 'd':
 			shapesEnabled = !shapesEnabled;
+			producer.setOverlays(overlayFlags());
 			break;
-		default:
+		case 'l': {
+			// Toggling the stats overlay, the engine only times its stages while it's shown
+			hudEnabled = !hudEnabled;
+			bool enabled = hudEnabled;
+			producer.post([enabled](MarchingSquaresEngine &engine) {
+				engine.setStatsEnabled(enabled);
+			});
 			break;
-	}
-}
-
-//////////////////////////////
-// MarchingSquares functions
-//////////////////////////
-
-MarchingSquare* findSquare(const vec3 &pos) {
-	MarchingSquare *foundSquare = &nullSqr;
-	
-	// Approximating the grid element containing point pos
-	MarchingSquare originSqr = grid.at((int)(DIMENSION - pos.y) / 2).at((int)(pos.x + DIMENSION) / 2);
-	
-	// Searching nearby grid elements for pos
-	for (int i = originSqr.getRow() - 4; i <= originSqr.getRow() + 4; i++) {
-		for (int j = originSqr.getCol() - 4; j <= originSqr.getCol() + 4; j++) {
-			if (i < DIMENSION + 1 && i > 0 && j < DIMENSION + 1 && j > 0) {
-				if (grid.at(i).at(j).contains(pos)) {
-					foundSquare = &grid.at(i).at(j);
-				}
-
-				// Breaking the loop after square found
-				if (foundSquare != &nullSqr) {
-					break;
-				}
-			}
-		}
-	}
-
-	return foundSquare;
-}
-
-void resolveSquareStates(Ball &ball, MarchingSquare &square) {
-	int state = 0;
-
-	for (int i = square.getRow() - (ball.getRadius() * 2.0f); i <= square.getRow() + (ball.getRadius() * 2.0f); i++) {
-		for (int j = square.getCol() - (ball.getRadius() * 2.0f); j <= square.getCol() + (ball.getRadius() * 2.0f); j++) {
-			if (i < DIMENSION + 1 && i > 0 && j < DIMENSION + 1 && j > 0) {
-				// Note: getPosition() returns topLeft point p0
-				//		 Maybe should have called it topLeft()
-				if (ball.contains(grid.at(i).at(j).getPosition())) {
-					state = state | 1;
-				}
-
-				if (ball.contains(grid.at(i).at(j).botLeft())) {
-					state = state | 2;
-				}
-
-				if (ball.contains(grid.at(i).at(j).botRight())) {
-					state = state | 4;
-				}
-
-				if (ball.contains(grid.at(i).at(j).topRight())) {
-					state = state | 8;
-				}
-
-				if (state != 0) {
-					activateSquare(grid.at(i).at(j), ball, state);
-					state = 0;
-				}
-			}
 		}
-	}
-}
-
-void activateSquare(MarchingSquare &square, Ball &ball, int state) {
-	switch (state) {
-		case 1:
-			square.activate(ball.getColor(), TOP_LEFT);
-			break;
-		case 2:
-			square.activate(ball.getColor(), BOT_LEFT);
-			break;
-		case 3:
-			square.activate(ball.getColor(), LEFT);
-			break;
-		case 4:
-			square.activate(ball.getColor(), BOT_RIGHT);
-			break;
-		case 5:
-			square.activate(ball.getColor(), NEG_DIAG);
-			break;
-		case 6:
-			square.activate(ball.getColor(), BOTTOM);
+		case 'f':
+			// Cycling corner tests, occupancy field and metaball field
+			producer.post([](MarchingSquaresEngine &engine) {
+				engine.setClassificationMode(static_cast<ClassificationMode>((engine.getClassificationMode() + 1) % 3));
+			});
 			break;
-		case 7:
-			square.activate(ball.getColor(), INV_TOP_RIGHT);
-			break;
-		case 8:
-			square.activate(ball.getColor(), TOP_RIGHT);
-			break;
-		case 9:
-			square.activate(ball.getColor(), UPPER);
-			break;
-		case 10:
-			square.activate(ball.getColor(), POS_DIAG);
-			break;
-		case 11:
-			square.activate(ball.getColor(), INV_BOT_RIGHT);
-			break;
-		case 12:
-			square.activate(ball.getColor(), RIGHT);
+		case 'g':
+			// Cycling batched, instanced and indexed drawing, skipping instancing without driver support
+			renderMode = static_cast<MeshKind>((renderMode + 1) % 3);
+			if (renderMode == MESH_INSTANCED && !instancingSupported) {
+				renderMode = MESH_INDEXED;
+			}
+			producer.setMeshKind(renderMode);
 			break;
-		case 13:
-			square.activate(ball.getColor(), INV_BOT_LEFT);
+		case 'h':
+			// Toggling incremental classification, which only redoes squares near moving balls
+			producer.post([](MarchingSquaresEngine &engine) {
+				engine.setIncremental(!engine.isIncremental());
+			});
 			break;
-		case 14:
-			square.activate(ball.getColor(), INV_TOP_LEFT);
+		case 'j':
+			// Toggling the adaptive corner pass, which fills or skips whole blocks of squares
+			producer.post([](MarchingSquaresEngine &engine) {
+				engine.setAdaptive(!engine.isAdaptive());
+			});
 			break;
-		case 15:
-			square.activate(ball.getColor(), FILLED);
+		case 'k':
+			// Toggling collisions between balls
+			producer.post([](MarchingSquaresEngine &engine) {
+				engine.setCollisions(!engine.isColliding());
+			});
 			break;
 		default:
 			break;
 	}
-
-	activeSquares.push(&square);
-}
-
-Direction generateDirection() {
-	int direction = rand() % (8 - 1 + 1) + 1;
-	
-	Direction facing = NW;
-
-	switch (direction) {
-	case 1:
-		facing = NE;
-		break;
-	case 2:
-		facing = N;
-		break;
-	case 3:
-		facing = NW;
-		break;
-	case 4:
-		facing = W;
-		break;
-	case 5:
-		facing = SW;
-		break;
-	case 6:
-		facing = S;
-		break;
-	case 7:
-		facing = SE;
-		break;
-	case 8:
-		facing = E;
-		break;
-	default:
-		break;
-	}
-
-	return facing;
 }
 
-void populateGrid() {
-	for (GLfloat i = DIMENSION; i >= -1 * DIMENSION; i -= SQUARE_WIDTH) {
-		grid.push_back(std::vector<MarchingSquare>());
-
-		for (GLfloat j = -1 * DIMENSION; j <= DIMENSION; j += SQUARE_WIDTH) {
-			grid.back().push_back(MarchingSquare(grid.size(), grid.back().size(),
-								  vec3{ j, i, -1.0f }, vec4{ 0.2f, 0.29f, 0.82f, 1.0f }, 
-								  EMPTY));
-		}
-	}
-}
+#if INSTANCING_AVAILABLE
 
-void generateShapes(int numShapes) {
-	vec4 colors[] = {
-		// Yellow
-		{ 0.918f, 0.769f, 0.2f, 1.0f },
-		// Blue
-		{ 0.2f, 0.29f, 0.82f, 1.0f },
-		// Orange
-		{ 0.918f, 0.631f, 0.2f, 1.0f }
-	};
-
-	GLfloat speed = 2.0f;
-
-	// Populating list of shapes
-	for (int i = 0; i < numShapes; i++) {
-		// Generating random shape settings
-		GLfloat radius = rand() % ((int)DIMENSION / 5 - (int)DIMENSION / 8 + 1) + (int)DIMENSION / 8;
-
-		bool negX = (rand() % 2 == 0);
-		GLfloat x = rand() % (int)((DIMENSION / 2) - radius) + radius;
-		if (negX) {
-			x *= -1;
-		}
+//////////////////////////
+// Instanced Case Meshes
+//////////////////////
 
-		bool negY = (rand() % 2 == 1);
-		GLfloat y = rand() % (int)((DIMENSION / 2) - radius) + radius;
-		if (negY) {
-			y *= -1;
-		}
+GLuint compileShader(GLenum type, const char *source) {
+	GLuint shader = glCreateShader(type);
+	GLint compiled = GL_FALSE;
 
-		int color = rand() % (1 + 1);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
 
-		balls.push_back(Ball(radius, speed, vec3{ x, y, -1.0f }, directionsLookup[generateDirection()], colors[0]));
+	if (compiled != GL_TRUE) {
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		fprintf(stderr, "Case shader failed to compile: %s\n", log);
+		glDeleteShader(shader);
+		return 0;
 	}
-}
-
-////////////////
-// class: Ball
-////////////
 
-Ball::Ball(GLfloat radius, GLfloat speed, vec3 position, vec3 facing, vec4 color) {
-	this->radius = radius;
-	this->speed = speed;
-	this->position = position;
-	this->facing = facing;
-	this->color = color;
-	outOfBounds = false;
+	return shader;
 }
 
-bool Ball::contains(vec3 point) {
-	bool contained = false;
+// Uploads the case templates and builds the shader, false if the driver lacks GL 2.1 or ARB_instanced_arrays
+bool initInstancing() {
+	const char *version = (const char *)glGetString(GL_VERSION);
+	const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+	int major = 0;
+	int minor = 0;
 
-	if (position.x != point.x && position.y != point.y) {
-		if (pow(position.x - point.x, 2.0) + pow(position.y - point.y, 2.0) < (radius * radius)) {
-			contained = true;
-		}
-	} else {
-		if (position.x == point.x && abs(position.y - point.y) < radius) {
-			contained = true;
-		} else if (position.y == point.y && abs(position.x - point.x) < radius) {
-			contained = true;
-		}
+	if (version == NULL || sscanf(version, "%d.%d", &major, &minor) != 2 || major * 10 + minor < 21) {
+		return false;
 	}
 
-	return contained;
-}
-
-void Ball::move() {
-	position = position + (facing * speed);
-}
-
-void Ball::bounce(const vec3 &normal) {
-	int component = rand() % (3 - 1 + 1) + 1;
-	vec3 vec;
-
-	// Choosing i or j component
-	switch (component) {
-		case 1:
-			if (normal.x == 0.0f) {
-				vec = vec3{ 1.0f, 0.0f, 0.0f };
-			} else if (normal.y == 0.0f) {
-				vec = vec3{ 0.0f, 1.0f, 0.0f };
-			}
-			break;
-		case 2:
-			if (normal.x == 0.0f) {
-				vec = vec3{ 0.0f, 0.0f, 0.0f };
-			} else if (normal.y == 0.0f) {
-				vec = vec3{ 0.0f, 0.0f, 0.0f };
-			}
-			break;
-		case 3:
-			if (normal.x == 0.0f) {
-				vec = vec3{ -1.0f, 0.0f, 0.0f };
-			} else if (normal.y == 0.0f) {
-				vec = vec3{ 0.0f, -1.0f, 0.0f };
-			}
-			break;
-		default:
-			break;
+	if (extensions == NULL || strstr(extensions, "GL_ARB_instanced_arrays") == NULL) {
+		return false;
 	}
 
-	// Adding wall normal plus randomized i or j component yields bounce
-	facing = normal + vec;
-}
-
-GLfloat Ball::getRadius() {
-	return radius;
-}
-
-vec3 Ball::getPosition() {
-	return position;
-}
-
-vec3 Ball::getFacing() {
-	return facing;
-}
-
-vec4 Ball::getColor() {
-	return color;
-}
-
-void Ball::setOutOfBounds() {
-	outOfBounds = true;
-}
+	GLuint vertexShader = compileShader(GL_VERTEX_SHADER, CASE_VERTEX_SHADER);
+	GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, CASE_FRAGMENT_SHADER);
 
-void Ball::clearOutOfBounds() {
-	outOfBounds = false;
-}
-
-bool Ball::isOutOfBounds() {
-	return outOfBounds;
-}
-
-//////////////////////////
-// class: MarchingSquare
-//////////////////////
-
-MarchingSquare::MarchingSquare(int row, int col, vec3 p0, vec4 color, 
-								MarchingSquareState state) {
-	/*
-	*  p0----p3
-	*  |      |
-	*  |      |
-	*  p1----p2
-	*/	
-	this->p0 = p0;
-	p1 = p0 + vec3{ 0.0f, -1 * SQUARE_WIDTH, 0.0f};
-	p2 = p0 + vec3{ SQUARE_WIDTH, -1 * SQUARE_WIDTH, 0.0f };
-	p3 = p0 + vec3{ SQUARE_WIDTH, 0.0f, 0.0f };
-	center = (p0 + p2) / 2;
-	center.z = -1.0f;
-	this->color = color;
-	this->state = state;
-	this->row = row;
-	this->col = col;
-}
-
-bool MarchingSquare::contains(vec3 point) {
-	bool contained = false;
-
-	if ((point.x >= this->p0.x) && (point.x <= this->p3.x) && (point.y >= this->p1.y) && (point.y <= this->p0.y)) {
-		contained = true;
+	if (vertexShader == 0 || fragmentShader == 0) {
+		return false;
 	}
 
-	return contained;
-}
-
-void MarchingSquare::activate(const vec4 &color, MarchingSquareState state) {
-	this->color = color;
-	this->state = static_cast<MarchingSquareState>(static_cast<int>(this->state) | static_cast<int>(state));
-}
-
-void MarchingSquare::emptyState() {
-	state = EMPTY;
-}
-
-vec3 MarchingSquare::getPosition() {
-	return p0;
-}
-
-vec3 MarchingSquare::botLeft() {
-	return p1;
-}
-
-vec3 MarchingSquare::botRight() {
-	return p2;
-}
-
-vec3 MarchingSquare::topRight() {
-	return p3;
-}
-
-vec3 MarchingSquare::getCenter() {
-	return center;
-}
-
-vec4 MarchingSquare::getColor() {
-	return color;
-}
+	GLuint program = glCreateProgram();
+	GLint linked = GL_FALSE;
+
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	// Attribute 0 must not be instanced, so the template positions take it
+	glBindAttribLocation(program, 0, "position");
+	glLinkProgram(program);
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	if (linked != GL_TRUE) {
+		glDeleteProgram(program);
+		return false;
+	}
 
-MarchingSquareState MarchingSquare::getState() {
-	return state;
-}
+	caseRenderer.program = program;
+	caseRenderer.positionAttrib = glGetAttribLocation(program, "position");
+	caseRenderer.cellAttrib = glGetAttribLocation(program, "cell");
+	caseRenderer.colorAttrib = glGetAttribLocation(program, "color");
+	caseRenderer.gridUniform = glGetUniformLocation(program, "grid");
+	caseRenderer.scaleUniform = glGetUniformLocation(program, "scale");
 
-int MarchingSquare::getRow() {
-	return row;
-}
+	// Uploading all 16 templates once, back to back
+	std::vector<float> positions;
+	buildCaseTemplates(positions, caseRenderer.first, caseRenderer.count);
 
-int MarchingSquare::getCol() {
-	return col;
-}
+	glGenBuffers(1, &caseRenderer.templateBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, caseRenderer.templateBuffer);
+	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(float), positions.data(), GL_STATIC_DRAW);
 
-///////////////////////
-// class: SceneBounds
-///////////////////
+	glGenBuffers(1, &caseRenderer.instanceBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-SceneBounds::SceneBounds(GLfloat maxX, GLfloat minX, GLfloat maxY, GLfloat minY) {
-	this->maxX = maxX;
-	this->minX = minX;
-	this->maxY = maxY;
-	this->minY = minY;
+	return true;
 }
 
-bool SceneBounds::outOfBounds(Ball &ball) {
-	bool escaped = false;
-
-	if (ball.getPosition().x + ball.getRadius() > maxX || ball.getPosition().x - ball.getRadius() < minX || 
-		ball.getPosition().y + ball.getRadius() > maxY || ball.getPosition().y - ball.getRadius() < minY) {
-		escaped = true;
-	}
-
-	return escaped;
-}
+// One instanced draw per non empty case, reading the 8 byte records uploaded this frame
+void drawInstancedSquares(ProducedFrame &frame) {
+	MeshBuilder &mesh = frame.mesh;
+	const std::vector<SquareInstance> &instances = mesh.getInstances();
 
-vec3 SceneBounds::getWallNormal(Ball &ball) {
-	vec3 normal;
-
-	if (ball.getPosition().x + ball.getRadius() > maxX) {
-		normal = vec3{-1.0f, 0.0f, 0.0f};
-	} else if (ball.getPosition().x - ball.getRadius() < minX) {
-		normal = vec3{ 1.0f, 0.0f, 0.0f };
-	} else if (ball.getPosition().y + ball.getRadius() > maxY) {
-		normal = vec3{ 0.0f, -1.0f, 0.0f };
-	} else if (ball.getPosition().y - ball.getRadius() < minY) {
-		normal = vec3{ 0.0f, 1.0f, 0.0f };
+	if (instances.empty()) {
+		return;
 	}
 
-	return normal;
-}
-
-//////////////////////
-// lib: Vector Maths
-//////////////////
-
-GLfloat magnitude(const vec3 &vec) {
-	return sqrt((vec.x * vec.x) + (vec.y * vec.y) + (vec.z * vec.z));
-}
+	GLuint cell = (GLuint)caseRenderer.cellAttrib;
+	GLuint color = (GLuint)caseRenderer.colorAttrib;
+	GLuint position = (GLuint)caseRenderer.positionAttrib;
+
+	glUseProgram(caseRenderer.program);
+	glUniform2f(caseRenderer.gridUniform, frame.squareWidth, frame.dimension);
+	// Templates span -1 to 1, scaled to half a square width like the batched mesh
+	glUniform1f(caseRenderer.scaleUniform, frame.squareWidth / 2.0f);
+
+	// Pushing mesh slightly backward to prevent z-fighting with overlay
+	glPolygonOffset(1.0f, 1.0f);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	glBindBuffer(GL_ARRAY_BUFFER, caseRenderer.templateBuffer);
+	glEnableVertexAttribArray(position);
+	glVertexAttribPointer(position, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, caseRenderer.instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(SquareInstance), instances.data(), GL_STREAM_DRAW);
+	glEnableVertexAttribArray(cell);
+	glEnableVertexAttribArray(color);
+	glVertexAttribDivisorARB(cell, 1);
+	glVertexAttribDivisorARB(color, 1);
+
+	// GL 2.1 has no base instance, so each case points the instance attributes at its own run
+	for (int c = 1; c < CASE_COUNT; c++) {
+		int count = mesh.getCaseCount(c);
+
+		if (count == 0) {
+			continue;
+		}
 
-vec3 normalize(const vec3 &vec) {
-	return vec / magnitude(vec);
-}
+		TraceScope trace("drawCase", c);
+		size_t offset = mesh.getCaseFirst(c) * sizeof(SquareInstance);
 
-vec3 cross(const vec3 &u, const vec3 &v) {
-	return vec3{ (u.y * v.z) - (u.z * v.y), (u.z * v.x) - (u.x * v.z), (u.x * v.y) - (u.y * v.x) };
-}
+		glVertexAttribPointer(cell, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(SquareInstance), (const GLvoid *)offset);
+		glVertexAttribPointer(color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SquareInstance),
+			(const GLvoid *)(offset + offsetof(SquareInstance, color)));
+		glDrawArraysInstancedARB(GL_TRIANGLES, caseRenderer.first[c], caseRenderer.count[c], count);
+	}
 
-vec3 operator/(const vec3 &vec, const GLfloat &scalar) {
-	return vec3{ vec.x / scalar, vec.y / scalar, vec.z / scalar };
-}
+	glVertexAttribDivisorARB(cell, 0);
+	glVertexAttribDivisorARB(color, 0);
+	glDisableVertexAttribArray(cell);
+	glDisableVertexAttribArray(color);
+	glDisableVertexAttribArray(position);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glUseProgram(0);
 
-vec3 operator*(const vec3 &vec, const GLfloat &scalar) {
-	return vec3{ vec.x * scalar, vec.y * scalar, vec.z * scalar };
+	glDisable(GL_POLYGON_OFFSET_FILL);
 }
 
-vec3 operator+(const vec3 &u, const vec3 &v) {
-	return vec3{ u.x + v.x, u.y + v.y, u.z + v.z };
-}
+#endif
 
-vec3 operator-(const vec3 &u, const vec3 &v) {
-	return vec3{ u.x - v.x, u.y - v.y, u.z - v.z };
+void printUsage(const char *program) {
+	fprintf(stderr, "Usage: %s [--grid N] [--width W] [--balls N] [--radius MIN[:MAX]] [--window WxH] [--rate N] [--collide] [--trace FILE]\n", program);
 }
@@ -0,0 +1,2413 @@
+/*
+	Marching Squares - Engine
+	Grid, ball and classification core shared by the viewer and headless tools.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "caseTable.h"
+#include "marchingSquaresEngine.h"
+#include "tracer.h"
+
+// Corner bits are 1 top left, 2 bottom left, 4 bottom right and 8 top right
+static_assert(TOP_LEFT == 1 && BOT_LEFT == 2 && BOT_RIGHT == 4 && TOP_RIGHT == 8 && FILLED == CASE_COUNT - 1,
+	"cases must be their corner bits");
+
+//////////////////
+// Lookup Tables
+//////////////
+
+vec3 directionsLookup[]{
+	vec3{ 1.0f, 1.0f, 0.0f },
+	vec3{ 0.0f, 1.0f, 0.0f },
+	vec3{ -1.0f, 1.0f, 0.0f },
+	vec3{ -1.0f, 0.0f, 0.0f },
+	vec3{ -1.0f, -1.0f, 0.0f },
+	vec3{ 0.0f, -1.0f, 0.0f },
+	vec3{ 1.0f, -1.0f, 0.0f },
+	vec3{ 1.0f, 0.0f, 0.0f }
+};
+
+vec4 shapeColors[]{
+	// Yellow
+	vec4{ 0.918f, 0.769f, 0.2f, 1.0f },
+	// Blue
+	vec4{ 0.2f, 0.29f, 0.82f, 1.0f },
+	// Orange
+	vec4{ 0.918f, 0.631f, 0.2f, 1.0f }
+};
+
+///////////////////////
+// lib: Point Location
+///////////////////
+
+// Works out what the specialized paths can assume about a grid
+static GridGeometry describeGeometry(float extent, float width, int rows, int cols) {
+	int exponent;
+	GridGeometry geometry = { extent, width, 1.0f / width, rows, cols, -1, WIDTH_ANY };
+
+	if (width == 1.0f) {
+		geometry.widthKind = WIDTH_UNIT;
+	} else if (frexpf(width, &exponent) == 0.5f) {
+		geometry.widthKind = WIDTH_POWER_OF_TWO;
+	}
+
+	if (cols > 0 && (cols & (cols - 1)) == 0) {
+		geometry.colShift = 0;
+
+		while ((1 << geometry.colShift) < cols) {
+			geometry.colShift++;
+		}
+	}
+
+	return geometry;
+}
+
+/*
+*  Branch free point location, so batches of it vectorize. Squares own their
+*  top and left edges, so a point on an edge shared by two squares belongs to
+*  the one below or to the right of it. The outer bottom and right edges of
+*  the grid still belong to the last row and column. Anything outside the
+*  grid, or NaN, maps to NULL_SQUARE. Every instance gives the same squares:
+*  a power of two width's reciprocal is exact, so multiplying by it rounds
+*  exactly as dividing does.
+*/
+template<WidthKind kind, bool powerOfTwoCols>
+static inline int locatePoint(const GridGeometry &geometry, float x, float y) {
+	float col = x + geometry.extent;
+	float row = geometry.extent - y;
+	float maxCol = (float)geometry.cols;
+	float maxRow = (float)geometry.rows;
+
+	if (kind == WIDTH_POWER_OF_TWO) {
+		col *= geometry.inverseWidth;
+		row *= geometry.inverseWidth;
+	} else if (kind == WIDTH_ANY) {
+		col /= geometry.width;
+		row /= geometry.width;
+	}
+
+	bool inside = (col >= 0.0f) & (col <= maxCol) & (row >= 0.0f) & (row <= maxRow);
+
+	// Clamping before conversion keeps out of range and NaN inputs defined
+	col = col > 0.0f ? col : 0.0f;
+	row = row > 0.0f ? row : 0.0f;
+	col = col < maxCol ? col : maxCol;
+	row = row < maxRow ? row : maxRow;
+
+	int i = (int)row;
+	int j = (int)col;
+	i = i < geometry.rows - 1 ? i : geometry.rows - 1;
+	j = j < geometry.cols - 1 ? j : geometry.cols - 1;
+
+	int square = powerOfTwoCols ? (i << geometry.colShift) | j : i * geometry.cols + j;
+
+	return inside ? square : NULL_SQUARE;
+}
+
+template<WidthKind kind, bool powerOfTwoCols>
+static void locateSquaresSpan(const GridGeometry &geometry, const float *xs, const float *ys, int *squares, size_t count) {
+	// A local copy, so stores into squares can't force the geometry to be reloaded
+	GridGeometry local = geometry;
+
+	for (size_t k = 0; k < count; k++) {
+		squares[k] = locatePoint<kind, powerOfTwoCols>(local, xs[k], ys[k]);
+	}
+}
+
+// Indexed by WidthKind, then by whether the column count is a power of two
+static const LocateSquaresFunction locateSquaresKernels[3][2] = {
+	{ locateSquaresSpan<WIDTH_ANY, false>, locateSquaresSpan<WIDTH_ANY, true> },
+	{ locateSquaresSpan<WIDTH_POWER_OF_TWO, false>, locateSquaresSpan<WIDTH_POWER_OF_TWO, true> },
+	{ locateSquaresSpan<WIDTH_UNIT, false>, locateSquaresSpan<WIDTH_UNIT, true> }
+};
+
+//////////////////////////////////
+// class: MarchingSquaresEngine
+//////////////////////////////
+
+MarchingSquaresEngine::MarchingSquaresEngine(float dimension, float squareWidth)
+	: sceneBounds(dimension, -1.0f * dimension + BOUNDS_MARGIN_SQUARES * squareWidth,
+		dimension - BOUNDS_MARGIN_SQUARES * squareWidth, -1.0f * dimension) {
+	this->dimension = dimension;
+	this->squareWidth = squareWidth;
+	requestedDimension = dimension;
+	requestedWidth = squareWidth;
+	rows = 0;
+	cols = 0;
+	geometry = GridGeometry{ dimension, squareWidth, 1.0f / squareWidth, 0, 0, -1, WIDTH_ANY };
+	locateKernel = locateSquaresKernels[WIDTH_ANY][0];
+	palette.assign(shapeColors, shapeColors + SHAPE_COLOR_COUNT);
+	centerSquare = NULL_SQUARE;
+	mode = CORNER_TESTS;
+	fieldCols = 0;
+	fieldTop = 0;
+	fieldLeft = 0;
+	fieldBottom = -1;
+	fieldRight = -1;
+	kernels = &getBestClassifyKernels();
+	fieldTiled = false;
+	fieldSparse = false;
+	adaptive = false;
+	collisions = false;
+	statsEnabled = false;
+	clearFrameStats(stats);
+	tileRows = 0;
+	tileCols = 0;
+	incremental = false;
+	incrementalReady = false;
+	sparse = false;
+	sparseRequested = false;
+	chunkGeneration = 1;
+}
+
+// Grid extent and square width for the next populateGrid, which also moves the walls balls bounce off
+void MarchingSquaresEngine::setGeometry(float dimension, float squareWidth) {
+	requestedDimension = dimension;
+	requestedWidth = squareWidth;
+}
+
+// Returns false, keeping the grid it had, if the requested one is wider than MAX_GRID_SIDE squares
+bool MarchingSquaresEngine::populateGrid() {
+	// Square widths across the grid, rounded since a dimension of (n - 1) * width / 2
+	// can come out a hair under n - 1 widths when the width isn't a power of two
+	float span = 2.0f * requestedDimension / requestedWidth;
+	if (!(span >= 0.0f && span < MAX_GRID_SIDE - 0.5f)) {
+		return false;
+	}
+
+	dimension = requestedDimension;
+	squareWidth = requestedWidth;
+	sceneBounds = SceneBounds(dimension, -1.0f * dimension + BOUNDS_MARGIN_SQUARES * squareWidth,
+		dimension - BOUNDS_MARGIN_SQUARES * squareWidth, -1.0f * dimension);
+
+	// Squares run from dimension down to -dimension, one square width apart
+	rows = (int)lroundf(span) + 1;
+	cols = rows;
+
+	geometry = describeGeometry(dimension, squareWidth, rows, cols);
+	locateKernel = locateSquaresKernels[geometry.widthKind][geometry.colShift >= 0 ? 1 : 0];
+
+	// Handing every chunk back before the tiles holding them can be rebuilt
+	releaseChunks(true);
+	sparse = sparseRequested;
+
+	if (sparse) {
+		// Squares and vertices only get storage once a ball reaches their tile
+		std::vector<unsigned char>().swap(states);
+		std::vector<unsigned char>().swap(colors);
+		std::vector<float>().swap(field);
+		std::vector<unsigned char>().swap(fieldColors);
+		activeSquares.resize(0);
+
+		for (unsigned int t = 0; t < fieldTiles.size(); t++) {
+			tiles[fieldTiles[t]].touched = GridWindow{ 0, 0, -1, -1 };
+		}
+
+		fieldTiles.clear();
+	} else {
+		states.assign(rows * cols, EMPTY);
+		colors.assign(rows * cols, DEFAULT_SQUARE_COLOR);
+		activeSquares.resize(rows * cols);
+	}
+
+	buildTiles();
+	incrementalReady = false;
+
+	return true;
+}
+
+void MarchingSquaresEngine::generateShapes(int numShapes) {
+	generateShapes(numShapes, (int)dimension / 8, (int)dimension / 5);
+}
+
+void MarchingSquaresEngine::generateShapes(int numShapes, int minRadius, int maxRadius) {
+	float speed = 2.0f;
+
+	// Populating list of shapes
+	for (int i = 0; i < numShapes; i++) {
+		// Generating random shape settings
+		float radius = rand() % (maxRadius - minRadius + 1) + minRadius;
+
+		// Spawning in the inner half of the scene, at least one unit wide
+		int spawnRange = (int)((dimension / 2) - radius);
+		if (spawnRange < 1) {
+			spawnRange = 1;
+		}
+
+		bool negX = (rand() % 2 == 0);
+		float x = rand() % spawnRange + radius;
+		if (negX) {
+			x *= -1;
+		}
+
+		bool negY = (rand() % 2 == 1);
+		float y = rand() % spawnRange + radius;
+		if (negY) {
+			y *= -1;
+		}
+
+		int color = rand() % (1 + 1);
+
+		balls.add(Ball(radius, speed, vec3{ x, y, BALL_DEPTH }, directionsLookup[generateDirection()], shapeColors[0]));
+	}
+}
+
+void MarchingSquaresEngine::moveBalls() {
+	// Moving every ball and reorienting the ones that left the scene
+	StageTimer moveTimer(stats, STAGE_MOVE, statsEnabled);
+	int escapedCount = balls.move(sceneBounds, *kernels);
+	moveTimer.stop();
+
+	StageTimer boundsTimer(stats, STAGE_BOUNDS, statsEnabled);
+	balls.bounce(sceneBounds, escapedCount);
+	boundsTimer.stop();
+
+	if (statsEnabled) {
+		stats.stageMs[STAGE_COLLIDE] = 0.0;
+	}
+
+	if (collisions) {
+		StageTimer collideTimer(stats, STAGE_COLLIDE, statsEnabled);
+		balls.collide();
+	}
+}
+
+void MarchingSquaresEngine::classify() {
+	// Resolving each of the store's colors once per frame, then each ball's through them.
+	// The store adds colors in the order balls first use them, so entries come out as before.
+	const std::vector<vec4> &ballPalette = balls.getPalette();
+	storeColors.resize(ballPalette.size());
+	for (unsigned int i = 0; i < ballPalette.size(); i++) {
+		storeColors[i] = paletteIndex(ballPalette[i]);
+	}
+
+	ballColors.resize(balls.size());
+	for (unsigned int i = 0; i < balls.size(); i++) {
+		ballColors[i] = storeColors[balls.getColorIndex(i)];
+	}
+
+	deltas.clear();
+
+	if (statsEnabled) {
+		stats.stageMs[STAGE_LOCATE] = 0.0;
+	}
+
+	if (mode == CORNER_TESTS) {
+		StageTimer locateTimer(stats, STAGE_LOCATE, statsEnabled);
+		locateBalls();
+	}
+
+	StageTimer classifyTimer(stats, STAGE_CLASSIFY, statsEnabled);
+	// Incremental sets keep their count across frames, so only this frame's share is reported
+	size_t duplicates = statsEnabled ? activeSquares.getDuplicates() : 0;
+
+	// A sparse grid has no flat arrays to patch, so it always classifies from scratch
+	if (incremental && !sparse) {
+		classifyIncremental();
+	} else {
+		// Emptying last frame's squares before classifying this one
+		clearActiveSquares();
+		duplicates = 0;
+		classifyAll();
+	}
+
+	classifyTimer.stop();
+
+	if (statsEnabled) {
+		stats.activeSquares = activeSquares.size();
+		stats.duplicates = activeSquares.getDuplicates() - duplicates;
+		stats.balls = balls.size();
+	}
+}
+
+// Finds every ball's epicenter in one batch, before any square is touched
+void MarchingSquaresEngine::locateBalls() {
+	epicenters.resize(balls.size());
+
+	if (!balls.empty()) {
+		locateSquares(balls.getXs(), balls.getYs(), epicenters.data(), balls.size());
+	}
+}
+
+// Classifies the whole grid from scratch into an empty active set
+void MarchingSquaresEngine::classifyAll() {
+	bool fieldMode = (mode != CORNER_TESTS);
+
+	// Incremental frames patch the grid serially, so their full passes stay serial too.
+	// A sparse field goes tile by tile even on one thread, skipping the empty space,
+	// and a sparse grid only exists tile by tile.
+	if (sparse || (!incremental && (pool || (fieldMode && fieldSparse)))) {
+		classifyTiles();
+	} else if (fieldMode) {
+		// Evaluating each shared vertex once, then reading cases from the field
+		accumulateField();
+		resolveFieldStates();
+
+		// Keeping the epicenter overlay on the most recent ball
+		if (!balls.empty()) {
+			centerSquare = findSquare(balls.getPosition(balls.size() - 1));
+		}
+	} else {
+		for (unsigned int j = 0; j < balls.size(); j++) {
+			// Squares containing centers of shapes, found by locateBalls
+			int epicenter = epicenters[j];
+
+			if (epicenter != NULL_SQUARE) {
+				centerSquare = epicenter;
+				// Testing vertices of intersected squares and setting state
+				resolveSquareStates(j, epicenter);
+			}
+		}
+	}
+
+	if (fieldMode) {
+		// Scattered small balls leave most of the touched box without a single case
+		long long box = (long long)(fieldBottom - fieldTop + 1) * (fieldRight - fieldLeft + 1);
+		fieldSparse = fieldBottom >= fieldTop && (long long)activeSquares.size() * SPARSE_FIELD_RATIO < box;
+	}
+}
+
+// Advances the simulation one frame, leaving the frame's squares in activeSquares until the next
+void MarchingSquaresEngine::step() {
+	TraceScope trace("step");
+
+	moveBalls();
+	classify();
+}
+
+void MarchingSquaresEngine::clearActiveSquares() {
+	const std::vector<int> &squares = activeSquares.getSquares();
+
+	if (sparse) {
+		// Active squares always sit in tiles that kept their chunk
+		for (unsigned int i = 0; i < squares.size(); i++) {
+			SquareTile *tile = squareTile(squares[i]);
+			tile->chunk->states[(getRow(squares[i]) - tile->squares.top) * CHUNK_SIZE
+				+ getCol(squares[i]) - tile->squares.left] = EMPTY;
+		}
+	} else {
+		for (unsigned int i = 0; i < squares.size(); i++) {
+			states[squares[i]] = EMPTY;
+		}
+	}
+
+	activeSquares.clear();
+}
+
+int MarchingSquaresEngine::findSquare(const vec3 &pos) {
+	return locateSquare(pos.x, pos.y);
+}
+
+// Square holding the point, NULL_SQUARE outside the grid, see locatePoint. Single
+// lookups mostly land inside the grid, so returning early beats the branch free form.
+int MarchingSquaresEngine::locateSquare(float x, float y) {
+	float col = x + dimension;
+	float row = dimension - y;
+
+	if (geometry.widthKind == WIDTH_POWER_OF_TWO) {
+		col *= geometry.inverseWidth;
+		row *= geometry.inverseWidth;
+	} else if (geometry.widthKind == WIDTH_ANY) {
+		col /= squareWidth;
+		row /= squareWidth;
+	}
+
+	if (!(col >= 0.0f && col <= (float)cols && row >= 0.0f && row <= (float)rows)) {
+		return NULL_SQUARE;
+	}
+
+	int i = (int)row;
+	int j = (int)col;
+
+	i = i < rows ? i : rows - 1;
+	j = j < cols ? j : cols - 1;
+
+	return i * cols + j;
+}
+
+// Runs the locateSquaresSpan instance picked for the grid when it was populated
+void MarchingSquaresEngine::locateSquares(const float *xs, const float *ys, int *squares, size_t count) {
+	locateKernel(geometry, xs, ys, squares, count);
+}
+
+void MarchingSquaresEngine::resolveSquareStates(unsigned int ball, int square) {
+	TraceScope trace("resolveSquareStates", ball);
+
+	resolveWindow(ball, cornerWindow(ball, square), NULL);
+}
+
+/*
+*  Squares with a corner within a radius of the square holding the ball's
+*  center, clamped to the grid. The center lies somewhere in that square, so
+*  one extra square each way covers it whichever corner it is nearest.
+*/
+GridWindow MarchingSquaresEngine::cornerWindow(unsigned int ball, int square) {
+	int reach = (int)ceil(balls.getRadius(ball) / squareWidth) + 1;
+	int row = getRow(square);
+	int col = getCol(square);
+	GridWindow window = { row - reach, col - reach, row + reach, col + reach };
+
+	window.top = window.top < 0 ? 0 : window.top;
+	window.left = window.left < 0 ? 0 : window.left;
+	window.bottom = window.bottom >= rows ? rows - 1 : window.bottom;
+	window.right = window.right >= cols ? cols - 1 : window.right;
+
+	return window;
+}
+
+// Tests the corners of every square in window against one ball. Tiles collect
+// their squares themselves, otherwise they go straight into the active set
+// unless record is false. Each corner is tested once, a row at a time by the
+// corner kernel, and each row's cases come from two corner rows as in the
+// field modes. Corner (i, j) sits at j * width - dimension, dimension - i * width.
+void MarchingSquaresEngine::resolveWindow(unsigned int ball, const GridWindow &window, SquareTile *tile, bool record) {
+	if (adaptive && (window.bottom - window.top >= ADAPTIVE_LEAF_SIZE || window.right - window.left >= ADAPTIVE_LEAF_SIZE)) {
+		resolveBlock(ball, window, tile, record);
+		return;
+	}
+
+	vec3 position = balls.getPosition(ball);
+	float radius = balls.getRadius(ball);
+	unsigned char color = ballColors[ball];
+	int count = window.right - window.left + 1;
+	int stride = cols;
+	TileStorage storage = tileStorage(tile);
+
+	// Tiles classify in parallel, so each thread keeps its own rows
+	static thread_local std::vector<float> cornerRows;
+	static thread_local std::vector<unsigned char> cases;
+
+	if ((int)cases.size() < count) {
+		cornerRows.resize(2 * (count + 1));
+		cases.resize(count);
+	}
+
+	float *upper = cornerRows.data();
+	float *lower = upper + count + 1;
+	CornerSpan span = { upper - window.left, window.left, window.right + 1, squareWidth, dimension, position.x,
+		(dimension - window.top * squareWidth) - position.y, radius, radius * radius };
+
+	kernels->insideRow(span);
+
+	for (int i = window.top; i <= window.bottom; i++) {
+		unsigned char *rowStates = storage.states + (i - storage.top) * storage.squareStride - storage.left;
+		unsigned char *rowColors = storage.colors + (i - storage.top) * storage.squareStride - storage.left;
+
+		span.inside = lower - window.left;
+		span.dy = (dimension - (i + 1) * squareWidth) - position.y;
+		kernels->insideRow(span);
+		kernels->classifyRow(upper, lower, cases.data(), count, 0.5f);
+
+		for (int k = 0; k < count; k++) {
+			// Skipping eight empty squares at a time
+			unsigned long long chunk;
+			if (k + 8 <= count) {
+				memcpy(&chunk, &cases[k], sizeof(chunk));
+				if (chunk == 0) {
+					k += 7;
+					continue;
+				}
+			}
+
+			int state = cases[k];
+			int j = window.left + k;
+
+			if (state != 0) {
+				if (!record) {
+					// Leaving the active set to whoever is patching the grid
+					activate(i * stride + j, color, static_cast<MarchingSquareState>(state));
+				} else if (tile == NULL) {
+					activateSquare(i * stride + j, color, state);
+				} else {
+					rowColors[j] = color;
+					rowStates[j] = rowStates[j] | static_cast<unsigned char>(state);
+					recordSquare(i, j, tile);
+				}
+			}
+		}
+
+		std::swap(upper, lower);
+	}
+}
+
+// Skips a window whose corners all lie outside the ball, fills one whose corners
+// all lie inside, and otherwise splits it into quarters. Both decisions keep a
+// margin wider than the rounding in Ball::contains, so the cases match testing
+// every corner. Squares are recorded quarter by quarter rather than row by row.
+void MarchingSquaresEngine::resolveBlock(unsigned int ball, const GridWindow &window, SquareTile *tile, bool record) {
+	vec3 position = balls.getPosition(ball);
+	double radius = balls.getRadius(ball);
+	float width = squareWidth;
+	float extent = dimension;
+
+	// Corner coordinates computed the same way as in resolveWindow
+	double minX = window.left * width - extent;
+	double maxX = (window.right + 1) * width - extent;
+	double maxY = extent - window.top * width;
+	double minY = extent - (window.bottom + 1) * width;
+	double slack = 8.0 * FLT_EPSILON * (extent + width + radius);
+
+	double nearX = position.x < minX ? minX - position.x : position.x > maxX ? position.x - maxX : 0.0;
+	double nearY = position.y < minY ? minY - position.y : position.y > maxY ? position.y - maxY : 0.0;
+
+	if (nearX * nearX + nearY * nearY > (radius + slack) * (radius + slack)) {
+		return;
+	}
+
+	double farX = std::max(fabs(minX - position.x), fabs(maxX - position.x));
+	double farY = std::max(fabs(minY - position.y), fabs(maxY - position.y));
+
+	if (radius > slack && farX * farX + farY * farY < (radius - slack) * (radius - slack)) {
+		fillWindow(ball, window, tile, record);
+		return;
+	}
+
+	int midRow = (window.top + window.bottom) / 2;
+	int midCol = (window.left + window.right) / 2;
+	GridWindow quarters[4] = {
+		GridWindow{ window.top, window.left, midRow, midCol },
+		GridWindow{ window.top, midCol + 1, midRow, window.right },
+		GridWindow{ midRow + 1, window.left, window.bottom, midCol },
+		GridWindow{ midRow + 1, midCol + 1, window.bottom, window.right }
+	};
+
+	for (int q = 0; q < 4; q++) {
+		if (quarters[q].top <= quarters[q].bottom && quarters[q].left <= quarters[q].right) {
+			resolveWindow(ball, quarters[q], tile, record);
+		}
+	}
+}
+
+// Sets every square of a window lying wholly inside the ball to FILLED
+void MarchingSquaresEngine::fillWindow(unsigned int ball, const GridWindow &window, SquareTile *tile, bool record) {
+	unsigned char color = ballColors[ball];
+	int stride = cols;
+	TileStorage storage = tileStorage(tile);
+
+	for (int i = window.top; i <= window.bottom; i++) {
+		unsigned char *rowStates = storage.states + (i - storage.top) * storage.squareStride - storage.left;
+		unsigned char *rowColors = storage.colors + (i - storage.top) * storage.squareStride - storage.left;
+
+		for (int j = window.left; j <= window.right; j++) {
+			if (!record) {
+				activate(i * stride + j, color, FILLED);
+			} else if (tile == NULL) {
+				activateSquare(i * stride + j, color, FILLED);
+			} else {
+				rowColors[j] = color;
+				rowStates[j] = FILLED;
+				recordSquare(i, j, tile);
+			}
+		}
+	}
+}
+
+// Case values are the corner bits themselves, so the state is stored as it is
+void MarchingSquaresEngine::activateSquare(int square, unsigned char color, int state) {
+	if (state != EMPTY) {
+		activate(square, color, static_cast<MarchingSquareState>(state));
+	}
+
+	activeSquares.insert(square);
+}
+
+// Sizes the field for the grid, returning true when it was freshly zeroed
+bool MarchingSquaresEngine::allocateField() {
+	int vertexRows = rows + 1;
+	int vertexCols = cols + 1;
+
+	if ((int)field.size() == vertexRows * vertexCols) {
+		return false;
+	}
+
+	field.assign(vertexRows * vertexCols, 0.0f);
+	fieldColors.assign(vertexRows * vertexCols, DEFAULT_SQUARE_COLOR);
+	fieldCols = vertexCols;
+
+	return true;
+}
+
+void MarchingSquaresEngine::clearField(const TileStorage &storage, const GridWindow &region) {
+	for (int i = region.top; i <= region.bottom; i++) {
+		float *row = storage.field + (i - storage.top) * storage.vertexStride - storage.left;
+
+		for (int j = region.left; j <= region.right; j++) {
+			row[j] = 0.0f;
+		}
+	}
+}
+
+// Vertices within reach of a ball, clamped to the grid
+GridWindow MarchingSquaresEngine::vertexWindow(unsigned int ball) {
+	vec3 position = balls.getPosition(ball);
+	float radius = balls.getRadius(ball);
+	float reach = (mode == METABALL_FIELD) ? radius * METABALL_REACH : radius;
+	float width = squareWidth;
+	float extent = dimension;
+
+	// Vertex (i, j) sits at x = j * width - dimension, y = dimension - i * width
+	GridWindow window = { (int)ceil((extent - (position.y + reach)) / width), (int)ceil((position.x - reach + extent) / width),
+		(int)floor((extent - (position.y - reach)) / width), (int)floor((position.x + reach + extent) / width) };
+
+	window.top = window.top < 0 ? 0 : window.top;
+	window.left = window.left < 0 ? 0 : window.left;
+	window.bottom = window.bottom > rows ? rows : window.bottom;
+	window.right = window.right > cols ? cols : window.right;
+
+	return window;
+}
+
+// Sums every ball's contribution into the vertex field, touching only vertices within reach
+void MarchingSquaresEngine::accumulateField() {
+	if (!allocateField()) {
+		// Clearing only the region written last frame
+		clearField(tileStorage(NULL), GridWindow{ fieldTop, fieldLeft, fieldBottom, fieldRight });
+	}
+
+	// The cleared region covered every tile, so none of them hold values anymore
+	if (fieldTiled) {
+		for (unsigned int t = 0; t < fieldTiles.size(); t++) {
+			tiles[fieldTiles[t]].touched = GridWindow{ 0, 0, -1, -1 };
+		}
+
+		fieldTiles.clear();
+		fieldTiled = false;
+	}
+
+	fieldTop = rows + 1;
+	fieldLeft = cols + 1;
+	fieldBottom = -1;
+	fieldRight = -1;
+
+	// Member reads would be reloaded after every byte store, locals are not
+	float width = squareWidth;
+	float extent = dimension;
+	bool metaball = (mode == METABALL_FIELD);
+
+	for (unsigned int b = 0; b < balls.size(); b++) {
+		GridWindow window = vertexWindow(b);
+
+		if (window.top > window.bottom || window.left > window.right) {
+			continue;
+		}
+
+		vec3 position = balls.getPosition(b);
+		float radius = balls.getRadius(b);
+		float reach = metaball ? radius * METABALL_REACH : radius;
+		FieldSpan span = { NULL, NULL, window.left, window.right, width, extent, position.x, 0.0f,
+			metaball ? reach * reach : radius * radius, metaball, ballColors[b] };
+
+		for (int i = window.top; i <= window.bottom; i++) {
+			span.field = &field[i * fieldCols];
+			span.colors = &fieldColors[i * fieldCols];
+			span.dy = extent - i * width - position.y;
+
+			kernels->accumulateSpan(span);
+		}
+
+		fieldTop = window.top < fieldTop ? window.top : fieldTop;
+		fieldLeft = window.left < fieldLeft ? window.left : fieldLeft;
+		fieldBottom = window.bottom > fieldBottom ? window.bottom : fieldBottom;
+		fieldRight = window.right > fieldRight ? window.right : fieldRight;
+	}
+}
+
+// Builds every square's case from its four field corners in one pass over the touched region
+void MarchingSquaresEngine::resolveFieldStates() {
+	if (fieldBottom < 0) {
+		return;
+	}
+
+	// Squares with any corner in the touched region
+	GridWindow region = { fieldTop > 0 ? fieldTop - 1 : 0, fieldLeft > 0 ? fieldLeft - 1 : 0,
+		fieldBottom < rows ? fieldBottom : rows - 1, fieldRight < cols ? fieldRight : cols - 1 };
+
+	resolveFieldRows(region, NULL);
+}
+
+void MarchingSquaresEngine::resolveFieldRows(const GridWindow &region, SquareTile *tile) {
+	float threshold = getFieldThreshold();
+	int left = region.left;
+	int right = region.right;
+	TileStorage storage = tileStorage(tile);
+
+	for (int i = region.top; i <= region.bottom; i++) {
+		unsigned char *rowStates = storage.states + (i - storage.top) * storage.squareStride - storage.left;
+		unsigned char *rowColors = storage.colors + (i - storage.top) * storage.squareStride - storage.left;
+		const float *upper = storage.field + (i - storage.top) * storage.vertexStride - storage.left;
+
+		// Writing the whole span's cases at once, then picking out the non empty ones
+		kernels->classifyRow(upper + left, upper + storage.vertexStride + left,
+			rowStates + left, right - left + 1, threshold);
+
+		for (int j = left; j <= right; j++) {
+			// Skipping eight empty squares at a time
+			unsigned long long chunk;
+			if (j + 8 <= right + 1) {
+				memcpy(&chunk, rowStates + j, sizeof(chunk));
+				if (chunk == 0) {
+					j += 7;
+					continue;
+				}
+			}
+
+			int state = rowStates[j];
+
+			if (state != 0) {
+				rowColors[j] = fieldColor(storage, i, j, state);
+				recordSquare(i, j, tile);
+			}
+		}
+	}
+}
+
+// Colors a field square by the ball that last touched its first inside corner
+unsigned char MarchingSquaresEngine::fieldColor(const TileStorage &storage, int row, int col, int state) {
+	int stride = storage.vertexStride;
+	row -= storage.top;
+	col -= storage.left;
+
+	int corner = (state & 1) ? row * stride + col
+		: (state & 2) ? (row + 1) * stride + col
+		: (state & 4) ? (row + 1) * stride + col + 1
+		: row * stride + col + 1;
+
+	return storage.fieldColors[corner];
+}
+
+// Adds a square to the active set, or marks it and keeps it for the tile's merge
+void MarchingSquaresEngine::recordSquare(int row, int col, SquareTile *tile) {
+	int square = row * cols + col;
+
+	if (tile == NULL) {
+		activeSquares.insert(square);
+	} else if (tile->chunk != NULL) {
+		unsigned int &stamp = tile->chunk->stamps[(row - tile->squares.top) * CHUNK_SIZE + col - tile->squares.left];
+
+		if (stamp != chunkGeneration) {
+			stamp = chunkGeneration;
+			tile->active.push_back(square);
+		} else {
+			tile->duplicates++;
+		}
+	} else if (activeSquares.mark(square)) {
+		tile->active.push_back(square);
+	} else {
+		tile->duplicates++;
+	}
+}
+
+static GridWindow intersectWindows(const GridWindow &a, const GridWindow &b) {
+	return GridWindow{ a.top > b.top ? a.top : b.top, a.left > b.left ? a.left : b.left,
+		a.bottom < b.bottom ? a.bottom : b.bottom, a.right < b.right ? a.right : b.right };
+}
+
+// Smallest window holding both, treating empty windows as nothing
+static GridWindow joinWindows(const GridWindow &a, const GridWindow &b) {
+	if (a.top > a.bottom || a.left > a.right) {
+		return b;
+	} else if (b.top > b.bottom || b.left > b.right) {
+		return a;
+	}
+
+	return GridWindow{ a.top < b.top ? a.top : b.top, a.left < b.left ? a.left : b.left,
+		a.bottom > b.bottom ? a.bottom : b.bottom, a.right > b.right ? a.right : b.right };
+}
+
+static bool emptyWindow(const GridWindow &window) {
+	return window.top > window.bottom || window.left > window.right;
+}
+
+// Squares with a corner among the vertices in window
+static GridWindow vertexSquares(const GridWindow &window, int rows, int cols) {
+	return GridWindow{ window.top > 0 ? window.top - 1 : 0, window.left > 0 ? window.left - 1 : 0,
+		window.bottom < rows ? window.bottom : rows - 1, window.right < cols ? window.right : cols - 1 };
+}
+
+// Squares tested in the corner mode, or vertices reached in the field modes
+GridWindow MarchingSquaresEngine::ballWindow(unsigned int ball) {
+	if (mode != CORNER_TESTS) {
+		return vertexWindow(ball);
+	}
+
+	int epicenter = epicenters[ball];
+
+	if (epicenter == NULL_SQUARE) {
+		return GridWindow{ 0, 0, -1, -1 };
+	}
+
+	centerSquare = epicenter;
+
+	return cornerWindow(ball, epicenter);
+}
+
+// Cuts the grid into TILE_SIZE blocks of squares, keeping them if the grid hasn't changed
+void MarchingSquaresEngine::buildTiles() {
+	int newRows = (rows + TILE_SIZE - 1) / TILE_SIZE;
+	int newCols = (cols + TILE_SIZE - 1) / TILE_SIZE;
+
+	if (newRows == tileRows && newCols == tileCols) {
+		return;
+	}
+
+	tileRows = newRows;
+	tileCols = newCols;
+	tiles.clear();
+	tiles.resize(tileRows * tileCols);
+	queuedTiles.clear();
+	fieldTiles.clear();
+	// One bucket per tile, so a tile's index is also its bucket's
+	ballHash.resize(rows, cols, TILE_SIZE);
+	writtenHash.resize(rows, cols, TILE_SIZE);
+
+	for (int r = 0; r < tileRows; r++) {
+		for (int c = 0; c < tileCols; c++) {
+			SquareTile &tile = tiles[r * tileCols + c];
+			int bottom = (r + 1) * TILE_SIZE - 1;
+			int right = (c + 1) * TILE_SIZE - 1;
+
+			tile.squares = GridWindow{ r * TILE_SIZE, c * TILE_SIZE,
+				bottom < rows ? bottom : rows - 1, right < cols ? right : cols - 1 };
+			tile.duplicates = 0;
+			tile.touched = GridWindow{ 0, 0, -1, -1 };
+			tile.queued = false;
+			tile.chunk = NULL;
+		}
+	}
+}
+
+void MarchingSquaresEngine::queueTile(int tile) {
+	if (!tiles[tile].queued) {
+		tiles[tile].queued = true;
+		queuedTiles.push_back(tile);
+	}
+}
+
+// Hashes the balls into the tiles they reach, queueing every tile with work this frame
+void MarchingSquaresEngine::binBalls() {
+	TraceScope trace("binBalls");
+
+	for (unsigned int t = 0; t < queuedTiles.size(); t++) {
+		tiles[queuedTiles[t]].queued = false;
+	}
+
+	queuedTiles.clear();
+
+	// Tiles still holding last frame's field need clearing even with no balls left
+	if (mode != CORNER_TESTS) {
+		for (unsigned int t = 0; t < fieldTiles.size(); t++) {
+			queueTile(fieldTiles[t]);
+		}
+	}
+
+	windows.resize(balls.size());
+	reaches.resize(balls.size());
+
+	for (unsigned int b = 0; b < balls.size(); b++) {
+		windows[b] = ballWindow(b);
+
+		if (emptyWindow(windows[b])) {
+			reaches[b] = windows[b];
+		} else {
+			reaches[b] = (mode == CORNER_TESTS) ? windows[b] : vertexSquares(windows[b], rows, cols);
+		}
+	}
+
+	ballHash.build(reaches);
+
+	const std::vector<int> &occupied = ballHash.getOccupied();
+	for (unsigned int t = 0; t < occupied.size(); t++) {
+		queueTile(occupied[t]);
+	}
+
+	// Tile order keeps the merged active list the same from run to run
+	std::sort(queuedTiles.begin(), queuedTiles.end());
+}
+
+// Classifies the queued tiles, on the pool if there is one, then merges their squares in tile order
+void MarchingSquaresEngine::classifyTiles() {
+	bool fieldMode = (mode != CORNER_TESTS);
+
+	if (sparse) {
+		chunkGeneration++;
+
+		// Restamping every chunk once the counter wraps so stale stamps can't match
+		if (chunkGeneration == 0) {
+			chunkPool.resetStamps();
+			chunkGeneration = 1;
+		}
+	} else if (fieldMode) {
+		if (allocateField()) {
+			for (unsigned int t = 0; t < fieldTiles.size(); t++) {
+				tiles[fieldTiles[t]].touched = GridWindow{ 0, 0, -1, -1 };
+			}
+
+			fieldTiles.clear();
+		} else if (!fieldTiled) {
+			// Taking over from the serial pass, which only knows its bounding box
+			clearField(tileStorage(NULL), GridWindow{ fieldTop, fieldLeft, fieldBottom, fieldRight });
+		}
+
+		fieldTiled = true;
+	}
+
+	binBalls();
+
+	if (sparse) {
+		acquireChunks();
+	}
+
+	int count = (int)queuedTiles.size();
+
+	if (fieldMode) {
+		runTiles([this](int t) { accumulateTileField(queuedTiles[t]); });
+		// Tiles read their neighbours' border vertices, so every field must be finished first
+		runTiles([this](int t) { resolveTileField(queuedTiles[t]); });
+	} else {
+		runTiles([this](int t) { resolveTileCorners(queuedTiles[t]); });
+	}
+
+	if (sparse) {
+		releaseChunks(false);
+	}
+
+	if (fieldMode) {
+		fieldTiles.clear();
+	}
+
+	GridWindow touched = { 0, 0, -1, -1 };
+
+	for (int t = 0; t < count; t++) {
+		SquareTile &tile = tiles[queuedTiles[t]];
+		activeSquares.append(tile.active, tile.duplicates);
+
+		if (fieldMode && !emptyWindow(tile.touched)) {
+			fieldTiles.push_back(queuedTiles[t]);
+			touched = joinWindows(touched, tile.touched);
+		}
+	}
+
+	if (fieldMode) {
+		// The serial pass clears this box if it takes over
+		fieldTop = touched.top;
+		fieldLeft = touched.left;
+		fieldBottom = touched.bottom;
+		fieldRight = touched.right;
+
+		// Both are rebuilt before they're read again
+		std::swap(windows, writtenWindows);
+		std::swap(ballHash, writtenHash);
+
+		if (!balls.empty()) {
+			centerSquare = findSquare(balls.getPosition(balls.size() - 1));
+		}
+	}
+}
+
+// Runs body over the queued tiles, on the pool when there is one
+void MarchingSquaresEngine::runTiles(const std::function<void(int)> &body) {
+	int count = (int)queuedTiles.size();
+
+	if (pool) {
+		pool->parallelFor(count, body);
+		return;
+	}
+
+	for (int t = 0; t < count; t++) {
+		body(t);
+	}
+}
+
+void MarchingSquaresEngine::resolveTileCorners(int index) {
+	TraceScope trace("resolveTileCorners", index);
+
+	SquareTile &tile = tiles[index];
+	unsigned int count;
+	const unsigned int *tileBalls = ballHash.getBalls(index, count);
+
+	tile.active.clear();
+	tile.duplicates = 0;
+
+	for (unsigned int b = 0; b < count; b++) {
+		GridWindow window = intersectWindows(windows[tileBalls[b]], tile.squares);
+
+		if (!emptyWindow(window)) {
+			resolveWindow(tileBalls[b], window, &tile);
+		}
+	}
+}
+
+// Zeroes what the tile wrote into the field last frame, ball by ball when
+// the balls covered little of the box around them
+void MarchingSquaresEngine::clearTileField(int index, const GridWindow &owned) {
+	const GridWindow &touched = tiles[index].touched;
+
+	if (emptyWindow(touched)) {
+		return;
+	}
+
+	unsigned int count;
+	const unsigned int *written = writtenHash.getBalls(index, count);
+	long long covered = 0;
+
+	for (unsigned int b = 0; b < count; b++) {
+		GridWindow window = intersectWindows(writtenWindows[written[b]], owned);
+
+		if (!emptyWindow(window)) {
+			covered += (long long)(window.bottom - window.top + 1) * (window.right - window.left + 1);
+		}
+	}
+
+	TileStorage storage = tileStorage(&tiles[index]);
+
+	if (covered * 2 >= (long long)(touched.bottom - touched.top + 1) * (touched.right - touched.left + 1)) {
+		clearField(storage, touched);
+		return;
+	}
+
+	for (unsigned int b = 0; b < count; b++) {
+		GridWindow window = intersectWindows(writtenWindows[written[b]], owned);
+
+		if (!emptyWindow(window)) {
+			clearField(storage, window);
+		}
+	}
+}
+
+// Clears and refills the tile's own vertices, in ball order so sums match the serial pass.
+// A chunk also fills its copy of the next tiles' first vertex row and column, which
+// comes out the same as theirs since the same balls are summed in the same order.
+void MarchingSquaresEngine::accumulateTileField(int index) {
+	TraceScope trace("accumulateTileField", index);
+
+	SquareTile &tile = tiles[index];
+	unsigned int count;
+	const unsigned int *tileBalls = ballHash.getBalls(index, count);
+	TileStorage storage = tileStorage(&tile);
+	GridWindow owned = tile.squares;
+	owned.bottom = (tile.chunk != NULL || owned.bottom == rows - 1) ? owned.bottom + 1 : owned.bottom;
+	owned.right = (tile.chunk != NULL || owned.right == cols - 1) ? owned.right + 1 : owned.right;
+
+	clearTileField(index, owned);
+	tile.touched = GridWindow{ 0, 0, -1, -1 };
+
+	float width = squareWidth;
+	float extent = dimension;
+	bool metaball = (mode == METABALL_FIELD);
+
+	for (unsigned int b = 0; b < count; b++) {
+		unsigned int ball = tileBalls[b];
+		GridWindow window = intersectWindows(windows[ball], owned);
+
+		if (emptyWindow(window)) {
+			continue;
+		}
+
+		vec3 position = balls.getPosition(ball);
+		float radius = balls.getRadius(ball);
+		float reach = metaball ? radius * METABALL_REACH : radius;
+		FieldSpan span = { NULL, NULL, window.left, window.right, width, extent, position.x, 0.0f,
+			metaball ? reach * reach : radius * radius, metaball, ballColors[ball] };
+
+		for (int i = window.top; i <= window.bottom; i++) {
+			span.field = storage.field + (i - storage.top) * storage.vertexStride - storage.left;
+			span.colors = storage.fieldColors + (i - storage.top) * storage.vertexStride - storage.left;
+			span.dy = extent - i * width - position.y;
+
+			kernels->accumulateSpan(span);
+		}
+
+		tile.touched = joinWindows(tile.touched, window);
+	}
+}
+
+void MarchingSquaresEngine::resolveTileField(int index) {
+	TraceScope trace("resolveTileField", index);
+
+	SquareTile &tile = tiles[index];
+	unsigned int count;
+	const unsigned int *tileBalls = ballHash.getBalls(index, count);
+	// One bit per column of the tile, set for squares with a corner among any ball's vertices
+	unsigned long long rowMasks[TILE_SIZE] = { 0 };
+	int top = tile.squares.top;
+	int left = tile.squares.left;
+
+	tile.active.clear();
+	tile.duplicates = 0;
+
+	for (unsigned int b = 0; b < count; b++) {
+		GridWindow squares = intersectWindows(vertexSquares(windows[tileBalls[b]], rows, cols), tile.squares);
+
+		if (emptyWindow(squares)) {
+			continue;
+		}
+
+		int width = squares.right - squares.left + 1;
+		unsigned long long mask = (width == 64 ? ~0ULL : (1ULL << width) - 1) << (squares.left - left);
+
+		for (int i = squares.top; i <= squares.bottom; i++) {
+			rowMasks[i - top] |= mask;
+		}
+	}
+
+	// Classifying each run of marked squares once however many balls overlap it,
+	// with rows sharing a mask done together
+	int rowCount = tile.squares.bottom - top + 1;
+	int groupTop = 0;
+
+	for (int r = 1; r <= rowCount; r++) {
+		if (r < rowCount && rowMasks[r] == rowMasks[groupTop]) {
+			continue;
+		}
+
+		unsigned long long mask = rowMasks[groupTop];
+
+		while (mask != 0) {
+			int first = __builtin_ctzll(mask);
+			unsigned long long rest = ~(mask >> first);
+			int run = rest == 0 ? 64 - first : __builtin_ctzll(rest);
+
+			resolveFieldRows(GridWindow{ top + groupTop, left + first, top + r - 1, left + first + run - 1 }, &tile);
+
+			mask = first + run >= 64 ? 0 : mask & (~0ULL << (first + run));
+		}
+
+		groupTop = r;
+	}
+}
+
+// Gives every queued tile of a sparse grid a chunk to work in
+void MarchingSquaresEngine::acquireChunks() {
+	for (unsigned int t = 0; t < queuedTiles.size(); t++) {
+		SquareTile &tile = tiles[queuedTiles[t]];
+
+		if (tile.chunk == NULL) {
+			tile.chunk = chunkPool.acquire();
+			chunkedTiles.push_back(queuedTiles[t]);
+		}
+	}
+}
+
+// Hands back the chunks of tiles left without active squares, or every chunk
+void MarchingSquaresEngine::releaseChunks(bool all) {
+	unsigned int kept = 0;
+
+	for (unsigned int t = 0; t < chunkedTiles.size(); t++) {
+		SquareTile &tile = tiles[chunkedTiles[t]];
+
+		// Tiles skipped this frame still hold last frame's list
+		if (!all && tile.queued && !tile.active.empty()) {
+			chunkedTiles[kept++] = chunkedTiles[t];
+			continue;
+		}
+
+		// Leaving the chunk as clean as it was handed out
+		memset(tile.chunk->states, EMPTY, sizeof(tile.chunk->states));
+		clearField(tileStorage(&tile), tile.touched);
+		chunkPool.release(tile.chunk);
+		tile.chunk = NULL;
+		tile.active.clear();
+		tile.duplicates = 0;
+		tile.touched = GridWindow{ 0, 0, -1, -1 };
+	}
+
+	chunkedTiles.resize(kept);
+}
+
+// The tile's chunk in a sparse grid, otherwise the grid's own arrays
+TileStorage MarchingSquaresEngine::tileStorage(const SquareTile *tile) {
+	if (tile != NULL && tile->chunk != NULL) {
+		GridChunk *chunk = tile->chunk;
+
+		return TileStorage{ tile->squares.top, tile->squares.left, chunk->states, chunk->colors, CHUNK_SIZE,
+			chunk->field, chunk->fieldColors, CHUNK_VERTICES };
+	}
+
+	return TileStorage{ 0, 0, states.data(), colors.data(), cols, field.data(), fieldColors.data(), fieldCols };
+}
+
+SquareTile* MarchingSquaresEngine::squareTile(int square) {
+	return &tiles[(getRow(square) / TILE_SIZE) * tileCols + getCol(square) / TILE_SIZE];
+}
+
+// Reclassifies only squares whose corners a changed ball reached last frame or reaches now
+void MarchingSquaresEngine::classifyIncremental() {
+	if (!incrementalReady || previousPositions.size() != balls.size()) {
+		rebuildIncremental();
+		return;
+	}
+
+	bool fieldMode = (mode != CORNER_TESTS);
+	DirtyRegion &dirty = fieldMode ? dirtyVertices : dirtySquares;
+
+	dirtySquares.clear();
+	dirtyVertices.clear();
+	windows.resize(balls.size());
+
+	for (unsigned int b = 0; b < balls.size(); b++) {
+		windows[b] = ballWindow(b);
+
+		vec3 position = balls.getPosition(b);
+		const vec3 &previous = previousPositions[b];
+
+		// Both where the ball was and where it is now have to be redone
+		if (position.x != previous.x || position.y != previous.y || position.z != previous.z
+			|| balls.getRadius(b) != previousRadii[b] || ballColors[b] != previousColors[b]) {
+			dirty.add(previousWindows[b]);
+			dirty.add(windows[b]);
+		}
+	}
+
+	dirty.finish();
+	rememberBalls();
+
+	if (fieldMode) {
+		if (!dirty.empty()) {
+			accumulateDirtyField();
+			resolveDirtyField();
+		}
+
+		if (!balls.empty()) {
+			centerSquare = findSquare(balls.getPosition(balls.size() - 1));
+		}
+	} else if (!dirty.empty()) {
+		resolveDirtyCorners();
+	}
+}
+
+// Classifies everything from scratch, still reporting what changed as deltas
+void MarchingSquaresEngine::rebuildIncremental() {
+	const std::vector<int> &active = activeSquares.getSquares();
+
+	savedSquares.clear();
+	for (unsigned int i = 0; i < active.size(); i++) {
+		savedSquares.push_back(SquareDelta{ active[i], states[active[i]], EMPTY, colors[active[i]] });
+	}
+
+	clearActiveSquares();
+	classifyAll();
+
+	auto bySquare = [](const SquareDelta &a, const SquareDelta &b) { return a.square < b.square; };
+	std::sort(savedSquares.begin(), savedSquares.end(), bySquare);
+
+	for (unsigned int i = 0; i < savedSquares.size(); i++) {
+		const SquareDelta &saved = savedSquares[i];
+		unsigned char after = states[saved.square];
+
+		if (after != saved.before || (after != EMPTY && colors[saved.square] != saved.color)) {
+			deltas.push_back(SquareDelta{ saved.square, saved.before, after, colors[saved.square] });
+		}
+	}
+
+	for (unsigned int i = 0; i < active.size(); i++) {
+		SquareDelta key = { active[i], EMPTY, EMPTY, 0 };
+
+		if (!std::binary_search(savedSquares.begin(), savedSquares.end(), key, bySquare)) {
+			deltas.push_back(SquareDelta{ active[i], EMPTY, states[active[i]], colors[active[i]] });
+		}
+	}
+
+	std::sort(deltas.begin(), deltas.end(), bySquare);
+
+	windows.resize(balls.size());
+	for (unsigned int b = 0; b < balls.size(); b++) {
+		windows[b] = ballWindow(b);
+	}
+
+	dirtySquares.reset(rows);
+	dirtyVertices.reset(rows + 1);
+	rememberBalls();
+	incrementalReady = true;
+}
+
+void MarchingSquaresEngine::rememberBalls() {
+	previousPositions.resize(balls.size());
+	previousRadii.resize(balls.size());
+	previousColors.resize(balls.size());
+
+	for (unsigned int b = 0; b < balls.size(); b++) {
+		previousPositions[b] = balls.getPosition(b);
+		previousRadii[b] = balls.getRadius(b);
+		previousColors[b] = ballColors[b];
+	}
+
+	previousWindows = windows;
+}
+
+// Keeps the case and color of every dirty square, in span order
+void MarchingSquaresEngine::saveDirtySquares() {
+	const std::vector<int> &dirtyRows = dirtySquares.getRows();
+
+	savedStates.clear();
+	savedColors.clear();
+
+	for (unsigned int r = 0; r < dirtyRows.size(); r++) {
+		const std::vector<Span> &spans = dirtySquares.getSpans(dirtyRows[r]);
+
+		for (unsigned int s = 0; s < spans.size(); s++) {
+			int first = dirtyRows[r] * cols + spans[s].left;
+			int last = dirtyRows[r] * cols + spans[s].right;
+
+			savedStates.insert(savedStates.end(), states.begin() + first, states.begin() + last + 1);
+			savedColors.insert(savedColors.end(), colors.begin() + first, colors.begin() + last + 1);
+		}
+	}
+}
+
+// Compares the dirty squares against what was saved, updating the active set and deltas
+void MarchingSquaresEngine::commitDirtySquares() {
+	const std::vector<int> &dirtyRows = dirtySquares.getRows();
+	unsigned int k = 0;
+
+	for (unsigned int r = 0; r < dirtyRows.size(); r++) {
+		const std::vector<Span> &spans = dirtySquares.getSpans(dirtyRows[r]);
+
+		for (unsigned int s = 0; s < spans.size(); s++) {
+			for (int j = spans[s].left; j <= spans[s].right; j++, k++) {
+				int square = dirtyRows[r] * cols + j;
+				unsigned char before = savedStates[k];
+				unsigned char after = states[square];
+
+				if (before == after && (after == EMPTY || savedColors[k] == colors[square])) {
+					continue;
+				}
+
+				deltas.push_back(SquareDelta{ square, before, after, colors[square] });
+
+				if (before == EMPTY) {
+					activeSquares.insert(square);
+				} else if (after == EMPTY) {
+					activeSquares.erase(square);
+				}
+			}
+		}
+	}
+}
+
+// Empties the dirty squares, then lets every ball reaching them test their corners again in ball order
+void MarchingSquaresEngine::resolveDirtyCorners() {
+	const std::vector<int> &dirtyRows = dirtySquares.getRows();
+	GridWindow bounds = dirtySquares.getBounds();
+
+	saveDirtySquares();
+
+	for (unsigned int r = 0; r < dirtyRows.size(); r++) {
+		const std::vector<Span> &spans = dirtySquares.getSpans(dirtyRows[r]);
+
+		for (unsigned int s = 0; s < spans.size(); s++) {
+			memset(&states[dirtyRows[r] * cols + spans[s].left], EMPTY, spans[s].right - spans[s].left + 1);
+		}
+	}
+
+	for (unsigned int b = 0; b < balls.size(); b++) {
+		GridWindow window = intersectWindows(windows[b], bounds);
+
+		if (emptyWindow(window)) {
+			continue;
+		}
+
+		std::vector<int>::const_iterator row = std::lower_bound(dirtyRows.begin(), dirtyRows.end(), window.top);
+
+		for (; row != dirtyRows.end() && *row <= window.bottom; ++row) {
+			const std::vector<Span> &spans = dirtySquares.getSpans(*row);
+
+			for (unsigned int s = 0; s < spans.size(); s++) {
+				GridWindow part = { *row, spans[s].left > window.left ? spans[s].left : window.left,
+					*row, spans[s].right < window.right ? spans[s].right : window.right };
+
+				if (!emptyWindow(part)) {
+					resolveWindow(b, part, NULL, false);
+				}
+			}
+		}
+	}
+
+	commitDirtySquares();
+}
+
+// Zeroes the dirty vertices and sums every ball reaching them back in, in ball order as the full pass does
+void MarchingSquaresEngine::accumulateDirtyField() {
+	const std::vector<int> &dirtyRows = dirtyVertices.getRows();
+	GridWindow bounds = dirtyVertices.getBounds();
+
+	for (unsigned int r = 0; r < dirtyRows.size(); r++) {
+		const std::vector<Span> &spans = dirtyVertices.getSpans(dirtyRows[r]);
+
+		for (unsigned int s = 0; s < spans.size(); s++) {
+			std::fill(&field[dirtyRows[r] * fieldCols + spans[s].left], &field[dirtyRows[r] * fieldCols + spans[s].right] + 1, 0.0f);
+		}
+	}
+
+	float width = squareWidth;
+	float extent = dimension;
+	bool metaball = (mode == METABALL_FIELD);
+	GridWindow touched = { 0, 0, -1, -1 };
+
+	for (unsigned int b = 0; b < balls.size(); b++) {
+		touched = joinWindows(touched, windows[b]);
+
+		GridWindow window = intersectWindows(windows[b], bounds);
+
+		if (emptyWindow(window)) {
+			continue;
+		}
+
+		vec3 position = balls.getPosition(b);
+		float radius = balls.getRadius(b);
+		float reach = metaball ? radius * METABALL_REACH : radius;
+		FieldSpan span = { NULL, NULL, 0, -1, width, extent, position.x, 0.0f,
+			metaball ? reach * reach : radius * radius, metaball, ballColors[b] };
+
+		std::vector<int>::const_iterator row = std::lower_bound(dirtyRows.begin(), dirtyRows.end(), window.top);
+
+		for (; row != dirtyRows.end() && *row <= window.bottom; ++row) {
+			const std::vector<Span> &spans = dirtyVertices.getSpans(*row);
+
+			span.field = &field[*row * fieldCols];
+			span.colors = &fieldColors[*row * fieldCols];
+			span.dy = extent - *row * width - position.y;
+
+			for (unsigned int s = 0; s < spans.size(); s++) {
+				span.left = spans[s].left > window.left ? spans[s].left : window.left;
+				span.right = spans[s].right < window.right ? spans[s].right : window.right;
+
+				if (span.left <= span.right) {
+					kernels->accumulateSpan(span);
+				}
+			}
+		}
+	}
+
+	// Everything outside every ball's vertices is zero again, so the full pass only needs to clear this
+	fieldTop = touched.top;
+	fieldLeft = touched.left;
+	fieldBottom = touched.bottom;
+	fieldRight = touched.right;
+	fieldTiled = false;
+}
+
+// Reclassifies the squares with a corner among the dirty vertices
+void MarchingSquaresEngine::resolveDirtyField() {
+	const std::vector<int> &vertexRows = dirtyVertices.getRows();
+
+	for (unsigned int r = 0; r < vertexRows.size(); r++) {
+		const std::vector<Span> &spans = dirtyVertices.getSpans(vertexRows[r]);
+
+		for (unsigned int s = 0; s < spans.size(); s++) {
+			dirtySquares.add(vertexSquares(GridWindow{ vertexRows[r], spans[s].left, vertexRows[r], spans[s].right }, rows, cols));
+		}
+	}
+
+	dirtySquares.finish();
+	saveDirtySquares();
+
+	const std::vector<int> &dirtyRows = dirtySquares.getRows();
+	float threshold = getFieldThreshold();
+
+	for (unsigned int r = 0; r < dirtyRows.size(); r++) {
+		int i = dirtyRows[r];
+		const std::vector<Span> &spans = dirtySquares.getSpans(i);
+
+		for (unsigned int s = 0; s < spans.size(); s++) {
+			int left = spans[s].left;
+			int right = spans[s].right;
+
+			kernels->classifyRow(&field[i * fieldCols + left], &field[(i + 1) * fieldCols + left],
+				&states[i * cols + left], right - left + 1, threshold);
+
+			for (int j = left; j <= right; j++) {
+				if (states[i * cols + j] != EMPTY) {
+					colors[i * cols + j] = fieldColor(tileStorage(NULL), i, j, states[i * cols + j]);
+				}
+			}
+		}
+	}
+
+	commitDirtySquares();
+}
+
+void MarchingSquaresEngine::activate(int square, unsigned char color, MarchingSquareState state) {
+	colors[square] = color;
+	states[square] = states[square] | static_cast<unsigned char>(state);
+}
+
+void MarchingSquaresEngine::emptyState(int square) {
+	states[square] = EMPTY;
+}
+
+// Returns the palette entry for color, adding it while there is room
+unsigned char MarchingSquaresEngine::paletteIndex(const vec4 &color) {
+	for (unsigned int i = 0; i < palette.size(); i++) {
+		if (palette[i].x == color.x && palette[i].y == color.y && palette[i].z == color.z && palette[i].w == color.w) {
+			return static_cast<unsigned char>(i);
+		}
+	}
+
+	if (palette.size() < MAX_PALETTE_SIZE) {
+		palette.push_back(color);
+		return static_cast<unsigned char>(palette.size() - 1);
+	}
+
+	return DEFAULT_SQUARE_COLOR;
+}
+
+bool MarchingSquaresEngine::squareContains(int square, const vec3 &point) {
+	vec3 p0 = topLeft(square);
+
+	return (point.x >= p0.x) && (point.x <= p0.x + squareWidth) && (point.y >= p0.y - squareWidth) && (point.y <= p0.y);
+}
+
+/*
+*  p0----p3
+*  |      |
+*  |      |
+*  p1----p2
+*/
+vec3 MarchingSquaresEngine::topLeft(int square) {
+	return vec3{ getCol(square) * squareWidth - dimension, dimension - getRow(square) * squareWidth, -1.0f };
+}
+
+vec3 MarchingSquaresEngine::botLeft(int square) {
+	return topLeft(square) + vec3{ 0.0f, -1 * squareWidth, 0.0f };
+}
+
+vec3 MarchingSquaresEngine::botRight(int square) {
+	return topLeft(square) + vec3{ squareWidth, -1 * squareWidth, 0.0f };
+}
+
+vec3 MarchingSquaresEngine::topRight(int square) {
+	return topLeft(square) + vec3{ squareWidth, 0.0f, 0.0f };
+}
+
+vec3 MarchingSquaresEngine::getCenter(int square) {
+	return topLeft(square) + vec3{ squareWidth / 2.0f, -1 * squareWidth / 2.0f, 0.0f };
+}
+
+vec4 MarchingSquaresEngine::getColor(int square) {
+	return palette[getColorIndex(square)];
+}
+
+// Colors squares and balls can take, indexed by getColorIndex
+const std::vector<vec4>& MarchingSquaresEngine::getPalette() {
+	return palette;
+}
+
+// Palette index of the square's color
+unsigned char MarchingSquaresEngine::getColorIndex(int square) {
+	if (sparse) {
+		SquareTile *tile = squareTile(square);
+
+		if (tile->chunk == NULL) {
+			return DEFAULT_SQUARE_COLOR;
+		}
+
+		return tile->chunk->colors[(getRow(square) - tile->squares.top) * CHUNK_SIZE
+			+ getCol(square) - tile->squares.left];
+	}
+
+	return colors[square];
+}
+
+// Squares in a sparse grid's unstored tiles are empty
+MarchingSquareState MarchingSquaresEngine::getState(int square) {
+	if (sparse) {
+		SquareTile *tile = squareTile(square);
+
+		if (tile->chunk == NULL) {
+			return EMPTY;
+		}
+
+		return static_cast<MarchingSquareState>(tile->chunk->states[(getRow(square) - tile->squares.top) * CHUNK_SIZE
+			+ getCol(square) - tile->squares.left]);
+	}
+
+	return static_cast<MarchingSquareState>(states[square]);
+}
+
+// Power of two column counts split square indices with a shift and mask rather than a division
+int MarchingSquaresEngine::getRow(int square) {
+	return geometry.colShift >= 0 ? square >> geometry.colShift : square / cols;
+}
+
+int MarchingSquaresEngine::getCol(int square) {
+	return geometry.colShift >= 0 ? square & (cols - 1) : square % cols;
+}
+
+int MarchingSquaresEngine::getRows() {
+	return rows;
+}
+
+int MarchingSquaresEngine::getCols() {
+	return cols;
+}
+
+// Bytes held by the grid, its active set and, in the field modes, the vertex field.
+// A sparse grid counts its tiles and every chunk it has allocated instead.
+size_t MarchingSquaresEngine::getGridBytes() {
+	return states.capacity() + colors.capacity() + activeSquares.getBytes()
+		+ field.capacity() * sizeof(float) + fieldColors.capacity() + ballHash.getBytes() + writtenHash.getBytes()
+		+ (sparse ? tiles.capacity() * sizeof(SquareTile) + chunkPool.getBytes() : 0);
+}
+
+// Bytes the grid would need for a square count and mode, before allocating it.
+// For a sparse grid that's the tiles and their ball buckets, which cover the
+// whole grid, while chunks come and go with the balls.
+double MarchingSquaresEngine::estimateGridBytes(int rows, int cols, ClassificationMode mode, bool sparse) {
+	if (sparse) {
+		double tileCount = ((rows + TILE_SIZE - 1) / TILE_SIZE) * (double)((cols + TILE_SIZE - 1) / TILE_SIZE);
+		// A start and a cursor per bucket in both ball hashes
+		return tileCount * (sizeof(SquareTile) + 4 * sizeof(unsigned int));
+	}
+
+	// Case byte, palette byte and active set stamp per square
+	double bytes = (2.0 + sizeof(unsigned int)) * rows * cols;
+
+	if (mode != CORNER_TESTS) {
+		bytes += (sizeof(float) + 1.0) * (rows + 1.0) * (cols + 1.0);
+	}
+
+	return bytes;
+}
+
+// Uses the fastest kernels up to level that this CPU supports
+void MarchingSquaresEngine::setKernelLevel(KernelLevel level) {
+	kernels = &getClassifyKernels(level);
+}
+
+const ClassifyKernels& MarchingSquaresEngine::getKernels() {
+	return *kernels;
+}
+
+// Classifies tile by tile on a pool of threadCount threads, zero for one per core and one for serial
+void MarchingSquaresEngine::setThreadCount(unsigned int threadCount) {
+	if (threadCount == 0) {
+		threadCount = std::thread::hardware_concurrency();
+	}
+
+	if (threadCount <= 1) {
+		pool.reset();
+	} else {
+		pool.reset(new ThreadPool(threadCount));
+	}
+}
+
+unsigned int MarchingSquaresEngine::getThreadCount() {
+	return pool ? pool->getThreadCount() : 1;
+}
+
+// Keeps cases between frames, reclassifying only around balls that moved
+void MarchingSquaresEngine::setIncremental(bool incremental) {
+	this->incremental = incremental;
+	incrementalReady = false;
+}
+
+bool MarchingSquaresEngine::isIncremental() {
+	return incremental;
+}
+
+// Squares changed by the last classify, in square order. Only kept in incremental mode.
+const std::vector<SquareDelta>& MarchingSquaresEngine::getDeltas() {
+	return deltas;
+}
+
+// Fills or skips whole blocks of a ball's window in the corner mode, testing
+// corners only near its edge. Cases are the same, squares are recorded in a
+// different order.
+void MarchingSquaresEngine::setAdaptive(bool adaptive) {
+	this->adaptive = adaptive;
+}
+
+// Lets balls collide with each other, after the walls each step. Collisions draw
+// nothing from rand(), so seeded runs stay repeatable.
+void MarchingSquaresEngine::setCollisions(bool collisions) {
+	this->collisions = collisions;
+}
+
+bool MarchingSquaresEngine::isColliding() {
+	return collisions;
+}
+
+// Times each stage of moveBalls and classify, and counts what they produced.
+// While disabled nothing reads the clock.
+void MarchingSquaresEngine::setStatsEnabled(bool enabled) {
+	statsEnabled = enabled;
+	clearFrameStats(stats);
+}
+
+bool MarchingSquaresEngine::isStatsEnabled() {
+	return statsEnabled;
+}
+
+// Stats of the last moveBalls and classify, all zero while disabled
+const FrameStats& MarchingSquaresEngine::getStats() {
+	return stats;
+}
+
+bool MarchingSquaresEngine::isAdaptive() {
+	return adaptive;
+}
+
+// Stores the grid in chunks allocated per tile from the next populateGrid on.
+// Only the squares and vertices are sparse, the tile directory still has an
+// entry for every tile of the grid. Sparse grids are always classified tile by
+// tile and never incrementally.
+void MarchingSquaresEngine::setSparseGrid(bool sparse) {
+	sparseRequested = sparse;
+}
+
+bool MarchingSquaresEngine::isSparseGrid() {
+	return sparse;
+}
+
+// Tiles of a sparse grid currently holding a chunk
+size_t MarchingSquaresEngine::getChunkCount() {
+	return chunkPool.getInUse();
+}
+
+void MarchingSquaresEngine::setClassificationMode(ClassificationMode mode) {
+	this->mode = mode;
+	incrementalReady = false;
+}
+
+ClassificationMode MarchingSquaresEngine::getClassificationMode() {
+	return mode;
+}
+
+// Field value above which a vertex counts as inside
+float MarchingSquaresEngine::getFieldThreshold() {
+	if (mode == METABALL_FIELD) {
+		// A lone ball's kernel crosses this exactly at its radius
+		float edge = 1.0f - 1.0f / (METABALL_REACH * METABALL_REACH);
+		return edge * edge;
+	}
+
+	return 0.5f;
+}
+
+float MarchingSquaresEngine::getDimension() {
+	return dimension;
+}
+
+float MarchingSquaresEngine::getSquareWidth() {
+	return squareWidth;
+}
+
+const GridGeometry& MarchingSquaresEngine::getGeometry() {
+	return geometry;
+}
+
+ActiveSquareSet& MarchingSquaresEngine::getActiveSquares() {
+	return activeSquares;
+}
+
+BallStore& MarchingSquaresEngine::getBalls() {
+	return balls;
+}
+
+int MarchingSquaresEngine::getCenterSquare() {
+	return centerSquare;
+}
+
+// Maps the command line names corners, occupancy and metaball onto modes
+bool parseClassificationMode(const char *name, ClassificationMode &mode) {
+	const char *names[] = { "corners", "occupancy", "metaball" };
+
+	for (int i = 0; i < 3; i++) {
+		if (strcmp(name, names[i]) == 0) {
+			mode = static_cast<ClassificationMode>(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Reads a radius range as MIN:MAX, or a single radius for both
+bool parseRadiusRange(const char *text, int &minRadius, int &maxRadius) {
+	int count = sscanf(text, "%d:%d", &minRadius, &maxRadius);
+
+	if (count == 1) {
+		maxRadius = minRadius;
+	}
+
+	return count >= 1 && minRadius > 0 && maxRadius >= minRadius;
+}
+
+Direction generateDirection() {
+	int direction = rand() % (8 - 1 + 1) + 1;
+
+	Direction facing = NW;
+
+	switch (direction) {
+	case 1:
+		facing = NE;
+		break;
+	case 2:
+		facing = N;
+		break;
+	case 3:
+		facing = NW;
+		break;
+	case 4:
+		facing = W;
+		break;
+	case 5:
+		facing = SW;
+		break;
+	case 6:
+		facing = S;
+		break;
+	case 7:
+		facing = SE;
+		break;
+	case 8:
+		facing = E;
+		break;
+	default:
+		break;
+	}
+
+	return facing;
+}
+
+
+////////////////
+// class: Ball
+////////////
+
+Ball::Ball(float radius, float speed, vec3 position, vec3 facing, vec4 color) {
+	this->radius = radius;
+	this->speed = speed;
+	this->position = position;
+	this->facing = facing;
+	this->color = color;
+	outOfBounds = false;
+}
+
+// The corner kernels' insideRow makes this same test a row of corners at a time
+bool Ball::contains(vec3 point) {
+	bool contained = false;
+	double dx = position.x - point.x;
+	double dy = position.y - point.y;
+
+	if (dx != 0.0 && dy != 0.0) {
+		// Squares of floats are exact in double
+		if (dx * dx + dy * dy < (radius * radius)) {
+			contained = true;
+		}
+	} else {
+		if (position.x == point.x && abs(position.y - point.y) < radius) {
+			contained = true;
+		} else if (position.y == point.y && abs(position.x - point.x) < radius) {
+			contained = true;
+		}
+	}
+
+	return contained;
+}
+
+void Ball::move() {
+	position = position + (facing * speed);
+}
+
+void Ball::bounce(const vec3 &normal) {
+	facing = bounceDirection(normal);
+}
+
+// New facing off a wall, the wall normal plus a random sideways component
+vec3 bounceDirection(const vec3 &normal) {
+	int component = rand() % (3 - 1 + 1) + 1;
+	vec3 vec = vec3{ 0.0f, 0.0f, 0.0f };
+
+	// Choosing i or j component
+	switch (component) {
+		case 1:
+			if (normal.x == 0.0f) {
+				vec = vec3{ 1.0f, 0.0f, 0.0f };
+			} else if (normal.y == 0.0f) {
+				vec = vec3{ 0.0f, 1.0f, 0.0f };
+			}
+			break;
+		case 2:
+			if (normal.x == 0.0f) {
+				vec = vec3{ 0.0f, 0.0f, 0.0f };
+			} else if (normal.y == 0.0f) {
+				vec = vec3{ 0.0f, 0.0f, 0.0f };
+			}
+			break;
+		case 3:
+			if (normal.x == 0.0f) {
+				vec = vec3{ -1.0f, 0.0f, 0.0f };
+			} else if (normal.y == 0.0f) {
+				vec = vec3{ 0.0f, -1.0f, 0.0f };
+			}
+			break;
+		default:
+			break;
+	}
+
+	// Adding wall normal plus randomized i or j component yields bounce
+	return normal + vec;
+}
+
+void Ball::setSpeed(float speed) {
+	this->speed = speed;
+}
+
+float Ball::getSpeed() {
+	return speed;
+}
+
+float Ball::getRadius() {
+	return radius;
+}
+
+vec3 Ball::getPosition() {
+	return position;
+}
+
+// Places the ball without moving it along its facing, as when replaying a recording
+void Ball::setPosition(const vec3 &position) {
+	this->position = position;
+}
+
+vec3 Ball::getFacing() {
+	return facing;
+}
+
+vec4 Ball::getColor() {
+	return color;
+}
+
+void Ball::setOutOfBounds() {
+	outOfBounds = true;
+}
+
+void Ball::clearOutOfBounds() {
+	outOfBounds = false;
+}
+
+bool Ball::isOutOfBounds() {
+	return outOfBounds;
+}
+
+///////////////////////
+// class: SceneBounds
+///////////////////
+
+SceneBounds::SceneBounds(float maxX, float minX, float maxY, float minY) {
+	this->maxX = maxX;
+	this->minX = minX;
+	this->maxY = maxY;
+	this->minY = minY;
+}
+
+bool SceneBounds::outOfBounds(Ball &ball) {
+	bool escaped = false;
+
+	if (ball.getPosition().x + ball.getRadius() > maxX || ball.getPosition().x - ball.getRadius() < minX || 
+		ball.getPosition().y + ball.getRadius() > maxY || ball.getPosition().y - ball.getRadius() < minY) {
+		escaped = true;
+	}
+
+	return escaped;
+}
+
+vec3 SceneBounds::getWallNormal(Ball &ball) {
+	return getWallNormal(ball.getPosition().x, ball.getPosition().y, ball.getRadius());
+}
+
+vec3 SceneBounds::getWallNormal(float x, float y, float radius) {
+	vec3 normal;
+
+	if (x + radius > maxX) {
+		normal = vec3{-1.0f, 0.0f, 0.0f};
+	} else if (x - radius < minX) {
+		normal = vec3{ 1.0f, 0.0f, 0.0f };
+	} else if (y + radius > maxY) {
+		normal = vec3{ 0.0f, -1.0f, 0.0f };
+	} else if (y - radius < minY) {
+		normal = vec3{ 0.0f, 1.0f, 0.0f };
+	}
+
+	return normal;
+}
+
+float SceneBounds::getMaxX() {
+	return maxX;
+}
+
+float SceneBounds::getMinX() {
+	return minX;
+}
+
+float SceneBounds::getMaxY() {
+	return maxY;
+}
+
+float SceneBounds::getMinY() {
+	return minY;
+}
+
+/////////////////////
+// class: BallStore
+/////////////////
+
+BallStore::BallStore() {
+	pairTests = 0;
+	contacts = 0;
+}
+
+void BallStore::clear() {
+	xs.clear();
+	ys.clear();
+	facingXs.clear();
+	facingYs.clear();
+	speeds.clear();
+	radii.clear();
+	colorIndices.clear();
+	escaped.clear();
+	palette.clear();
+	sweep.clear();
+}
+
+void BallStore::reserve(size_t count) {
+	xs.reserve(count);
+	ys.reserve(count);
+	facingXs.reserve(count);
+	facingYs.reserve(count);
+	speeds.reserve(count);
+	radii.reserve(count);
+	colorIndices.reserve(count);
+	escaped.reserve(count);
+}
+
+// Appends a copy of ball, adding its color to the palette while there is room
+void BallStore::add(const Ball &ball) {
+	Ball copy = ball;
+	vec3 position = copy.getPosition();
+	vec3 facing = copy.getFacing();
+	vec4 color = copy.getColor();
+	unsigned int index = 0;
+
+	while (index < palette.size() && !(palette[index].x == color.x && palette[index].y == color.y
+		&& palette[index].z == color.z && palette[index].w == color.w)) {
+		index++;
+	}
+
+	if (index == palette.size()) {
+		if (palette.size() < MAX_PALETTE_SIZE) {
+			palette.push_back(color);
+		} else {
+			index = 0;
+		}
+	}
+
+	xs.push_back(position.x);
+	ys.push_back(position.y);
+	facingXs.push_back(facing.x);
+	facingYs.push_back(facing.y);
+	speeds.push_back(copy.getSpeed());
+	radii.push_back(copy.getRadius());
+	colorIndices.push_back(static_cast<unsigned char>(index));
+	escaped.push_back(copy.isOutOfBounds() ? 1 : 0);
+	// New balls join the end of the sweep and are sorted into place at the next collide
+	sweep.push_back(SweepEntry{ 0, 0.0f, 0.0f, (unsigned int)(xs.size() - 1) });
+}
+
+// Moves every ball one step, flagging the ones that just crossed a wall and returning how many did
+int BallStore::move(SceneBounds &bounds, const ClassifyKernels &kernels) {
+	if (xs.empty()) {
+		return 0;
+	}
+
+	BallSpan span = { xs.data(), ys.data(), facingXs.data(), facingYs.data(), speeds.data(), radii.data(),
+		escaped.data(), (int)xs.size(), bounds.getMinX(), bounds.getMaxX(), bounds.getMinY(), bounds.getMaxY() };
+
+	return kernels.moveBalls(span);
+}
+
+// Turns the balls the last move flagged. Turns draw from rand(), so they go in
+// ball order to keep seeded runs repeatable.
+void BallStore::bounce(SceneBounds &bounds, int flagged) {
+	for (size_t i = 0; flagged > 0; i++) {
+		// Skipping eight clear flags at a time
+		unsigned long long word = 0;
+		if (i + 8 <= escaped.size()) {
+			memcpy(&word, &escaped[i], sizeof(word));
+			if (word == 0) {
+				i += 7;
+				continue;
+			}
+		}
+
+		if (escaped[i] != 0) {
+			vec3 facing = bounceDirection(bounds.getWallNormal(xs[i], ys[i], radii[i]));
+			facingXs[i] = facing.x;
+			facingYs[i] = facing.y;
+			flagged--;
+		}
+	}
+}
+
+// Separates every pair of overlapping balls and exchanges their momentum along
+// the line between their centers. The balls are cut into horizontal bands as
+// tall as the widest ball, so touching balls share a band or sit in adjacent
+// ones, and sorted by band and then left edge. Sweeping that order tests each
+// ball only against balls in its own band and the band below that start
+// before it ends. Insertion sort keeps the order up to date, balls barely move
+// between steps so it does close to one comparison per ball. Contacts are
+// resolved one after another in sweep order, which only depends on positions.
+void BallStore::collide() {
+	size_t count = xs.size();
+	pairTests = 0;
+	contacts = 0;
+
+	float widest = 0.0f;
+	for (size_t i = 0; i < count; i++) {
+		widest = std::max(widest, 2.0f * radii[i]);
+	}
+
+	if (!(widest > 0.0f)) {
+		return;
+	}
+
+	// Refreshing each entry in place, so the order from the last step is the starting point
+	for (size_t i = 0; i < count; i++) {
+		SweepEntry &entry = sweep[i];
+		entry.band = (int)floorf(ys[entry.ball] / widest);
+		entry.left = xs[entry.ball] - radii[entry.ball];
+		entry.right = xs[entry.ball] + radii[entry.ball];
+	}
+
+	// Equal keys keep their order from the last step
+	auto before = [](const SweepEntry &a, const SweepEntry &b) {
+		return a.band < b.band || (a.band == b.band && a.left < b.left);
+	};
+	size_t shifts = 0;
+	bool sorted = true;
+
+	for (size_t i = 1; i < count && sorted; i++) {
+		SweepEntry entry = sweep[i];
+		size_t j = i;
+
+		while (j > 0 && before(entry, sweep[j - 1])) {
+			sweep[j] = sweep[j - 1];
+			j--;
+		}
+
+		sweep[j] = entry;
+		shifts += i - j;
+
+		// New balls or a change of band height can scramble the order, which a full sort handles better
+		sorted = shifts <= count * SWEEP_SHIFT_LIMIT;
+	}
+
+	if (!sorted) {
+		std::stable_sort(sweep.begin(), sweep.end(), before);
+	}
+
+	// First entry of the band below the current one, entries in it starting too far left are skipped for good
+	size_t below = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		const SweepEntry &entry = sweep[i];
+
+		for (size_t j = i + 1; j < count && sweep[j].band == entry.band && sweep[j].left <= entry.right; j++) {
+			testContact(entry.ball, sweep[j].ball);
+		}
+
+		below = std::max(below, i + 1);
+		while (below < count && (sweep[below].band <= entry.band
+			|| (sweep[below].band == entry.band + 1 && sweep[below].left < entry.left - widest))) {
+			below++;
+		}
+
+		for (size_t j = below; j < count && sweep[j].band == entry.band + 1 && sweep[j].left <= entry.right; j++) {
+			testContact(entry.ball, sweep[j].ball);
+		}
+	}
+}
+
+// Checks one pair the sweep found overlapping along x
+void BallStore::testContact(unsigned int a, unsigned int b) {
+	pairTests++;
+
+	if (fabsf(ys[b] - ys[a]) < radii[a] + radii[b]) {
+		resolveContact(a, b);
+	}
+}
+
+// Pushes a and b apart if they overlap, and if they're closing bounces them
+// elastically with masses going by area. Still balls act as fixed obstacles.
+void BallStore::resolveContact(unsigned int a, unsigned int b) {
+	float dx = xs[b] - xs[a];
+	float dy = ys[b] - ys[a];
+	float reach = radii[a] + radii[b];
+	float distSqr = dx * dx + dy * dy;
+
+	if (distSqr >= reach * reach) {
+		return;
+	}
+
+	float inverseA = speeds[a] != 0.0f && radii[a] > 0.0f ? 1.0f / (radii[a] * radii[a]) : 0.0f;
+	float inverseB = speeds[b] != 0.0f && radii[b] > 0.0f ? 1.0f / (radii[b] * radii[b]) : 0.0f;
+	float inverseSum = inverseA + inverseB;
+
+	if (inverseSum == 0.0f) {
+		return;
+	}
+
+	contacts++;
+
+	// Balls on the same spot are pushed apart along x
+	float dist = sqrtf(distSqr);
+	float normalX = dist > 0.0f ? dx / dist : 1.0f;
+	float normalY = dist > 0.0f ? dy / dist : 0.0f;
+
+	// Splitting the overlap by inverse mass
+	float overlap = (reach - dist) / inverseSum;
+	xs[a] -= normalX * overlap * inverseA;
+	ys[a] -= normalY * overlap * inverseA;
+	xs[b] += normalX * overlap * inverseB;
+	ys[b] += normalY * overlap * inverseB;
+
+	float velocityAX = facingXs[a] * speeds[a];
+	float velocityAY = facingYs[a] * speeds[a];
+	float velocityBX = facingXs[b] * speeds[b];
+	float velocityBY = facingYs[b] * speeds[b];
+	float closing = (velocityAX - velocityBX) * normalX + (velocityAY - velocityBY) * normalY;
+
+	// Balls already moving apart only needed separating
+	if (closing <= 0.0f) {
+		return;
+	}
+
+	float impulse = 2.0f * closing / inverseSum;
+
+	// Speeds stay as they were, so the new velocity goes into the facing
+	if (inverseA != 0.0f) {
+		facingXs[a] = (velocityAX - normalX * impulse * inverseA) / speeds[a];
+		facingYs[a] = (velocityAY - normalY * impulse * inverseA) / speeds[a];
+	}
+
+	if (inverseB != 0.0f) {
+		facingXs[b] = (velocityBX + normalX * impulse * inverseB) / speeds[b];
+		facingYs[b] = (velocityBY + normalY * impulse * inverseB) / speeds[b];
+	}
+}
+
+// Pairs whose x extents overlapped in the last collide
+size_t BallStore::getPairTests() {
+	return pairTests;
+}
+
+// Pairs that were touching in the last collide
+size_t BallStore::getContacts() {
+	return contacts;
+}
+
+size_t BallStore::size() {
+	return xs.size();
+}
+
+bool BallStore::empty() {
+	return xs.empty();
+}
+
+// A copy of one ball, for tests that want the whole thing
+Ball BallStore::get(unsigned int ball) {
+	Ball copy(radii[ball], speeds[ball], getPosition(ball), vec3{ facingXs[ball], facingYs[ball], 0.0f }, getColor(ball));
+
+	if (escaped[ball] != 0) {
+		copy.setOutOfBounds();
+	}
+
+	return copy;
+}
+
+vec3 BallStore::getPosition(unsigned int ball) {
+	return vec3{ xs[ball], ys[ball], BALL_DEPTH };
+}
+
+// Places the ball without moving it along its facing, as when replaying a recording
+void BallStore::setPosition(unsigned int ball, const vec3 &position) {
+	xs[ball] = position.x;
+	ys[ball] = position.y;
+}
+
+float BallStore::getX(unsigned int ball) {
+	return xs[ball];
+}
+
+float BallStore::getY(unsigned int ball) {
+	return ys[ball];
+}
+
+// Every ball's x, in ball order, for batch passes such as point location
+const float* BallStore::getXs() {
+	return xs.data();
+}
+
+const float* BallStore::getYs() {
+	return ys.data();
+}
+
+float BallStore::getRadius(unsigned int ball) {
+	return radii[ball];
+}
+
+void BallStore::setSpeed(unsigned int ball, float speed) {
+	speeds[ball] = speed;
+}
+
+vec4 BallStore::getColor(unsigned int ball) {
+	return palette[colorIndices[ball]];
+}
+
+unsigned char BallStore::getColorIndex(unsigned int ball) {
+	return colorIndices[ball];
+}
+
+// Every color a ball in the store has had, in the order they were first added
+const std::vector<vec4>& BallStore::getPalette() {
+	return palette;
+}
+
+//////////////////////
+// lib: Vector Maths
+//////////////////
+
+float magnitude(const vec3 &vec) {
+	return sqrt((vec.x * vec.x) + (vec.y * vec.y) + (vec.z * vec.z));
+}
+
+vec3 normalize(const vec3 &vec) {
+	return vec / magnitude(vec);
+}
+
+vec3 cross(const vec3 &u, const vec3 &v) {
+	return vec3{ (u.y * v.z) - (u.z * v.y), (u.z * v.x) - (u.x * v.z), (u.x * v.y) - (u.y * v.x) };
+}
+
+vec3 operator/(const vec3 &vec, const float &scalar) {
+	return vec3{ vec.x / scalar, vec.y / scalar, vec.z / scalar };
+}
+
+vec3 operator*(const vec3 &vec, const float &scalar) {
+	return vec3{ vec.x * scalar, vec.y * scalar, vec.z * scalar };
+}
+
+vec3 operator+(const vec3 &u, const vec3 &v) {
+	return vec3{ u.x + v.x, u.y + v.y, u.z + v.z };
+}
+
+vec3 operator-(const vec3 &u, const vec3 &v) {
+	return vec3{ u.x - v.x, u.y - v.y, u.z - v.z };
+}
@@ -0,0 +1,512 @@
+/*
+	Marching Squares - Engine
+	Grid, ball and classification core shared by the viewer and headless tools.
+	Nothing in here may depend on OpenGL or GLUT.
+*/
+
+#ifndef MARCHING_SQUARES_ENGINE_H
+#define MARCHING_SQUARES_ENGINE_H
+
+#include <stddef.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "activeSquareSet.h"
+#include "chunkPool.h"
+#include "classifyKernels.h"
+#include "dirtyRegion.h"
+#include "frameStats.h"
+#include "spatialHash.h"
+#include "threadPool.h"
+
+/////////////////////////
+// Scene Const
+/////////////////////
+
+// Defaults for the grid, which can be set at startup through setGeometry
+const float DIMENSION = 100;
+const float SQUARE_WIDTH = 2.0f;
+
+// Balls bounce this many squares short of the grid's left and top edges
+const float BOUNDS_MARGIN_SQUARES = 2.0f;
+
+// Balls sit on this z plane, in front of the camera
+const float BALL_DEPTH = -1.0f;
+
+// Moves per ball past which keeping the collision sweep sorted falls back to a full sort
+const size_t SWEEP_SHIFT_LIMIT = 8;
+
+// Support radius of a metaball kernel as a multiple of the ball radius
+const float METABALL_REACH = 2.0f;
+
+// Returned by findSquare when no square contains the point
+const int NULL_SQUARE = -1;
+
+// Squares per side of the largest grid. Square and vertex indices are ints,
+// and one more vertex than square per side must still fit.
+const int MAX_GRID_SIDE = 46339;
+
+// Squares start out blue, the second entry of shapeColors
+const unsigned char DEFAULT_SQUARE_COLOR = 1;
+const int SHAPE_COLOR_COUNT = 3;
+const unsigned int MAX_PALETTE_SIZE = 256;
+
+// Squares per side of a tile when classifying in parallel, at most 64 so a
+// tile row's squares fit one bit each in a 64 bit mask. A sparse grid stores
+// each tile in one chunk.
+const int TILE_SIZE = CHUNK_SIZE;
+
+// A field pass whose box holds this many squares per active square counts
+// as sparse, and runs tile by tile through the spatial hash even on one thread
+const int SPARSE_FIELD_RATIO = 64;
+
+// Squares per side below which the adaptive corner pass stops splitting a
+// window and tests every corner in it
+const int ADAPTIVE_LEAF_SIZE = 4;
+
+//////////////////////////////
+// Vector Maths Declarations
+//////////////////////////
+
+typedef struct vec3 {
+	float x;
+	float y;
+	float z;
+} vec3;
+
+typedef struct vec4 {
+	float x;
+	float y;
+	float z;
+	float w;
+} vec4;
+
+float magnitude(const vec3 &vec);
+vec3 normalize(const vec3 &vec);
+vec3 cross(const vec3 &u, const vec3 &v);
+vec3 operator/(const vec3 &vec, const float &scalar);
+vec3 operator*(const vec3 &vec, const float &scalar);
+vec3 operator+(const vec3 &u, const vec3 &v);
+vec3 operator-(const vec3 &u, const vec3 &v);
+
+//////////////////////////////////
+// Marching Squares Declarations
+//////////////////////////////
+
+typedef enum Direction {
+	NE,
+	N,
+	NW,
+	W,
+	SW,
+	S,
+	SE,
+	E
+} Direction;
+
+typedef enum MarchingSquareState {
+	EMPTY,
+	TOP_LEFT,
+	BOT_LEFT,
+	LEFT,
+	BOT_RIGHT,
+	NEG_DIAG,
+	BOTTOM,
+	INV_TOP_RIGHT,
+	TOP_RIGHT,
+	UPPER,
+	POS_DIAG,
+	INV_BOT_RIGHT,
+	RIGHT,
+	INV_BOT_LEFT,
+	INV_TOP_LEFT,
+	FILLED
+} MarchingSquareState;
+
+typedef enum ClassificationMode {
+	// Testing the four corners of every square near a ball with Ball::contains
+	CORNER_TESTS,
+	// Counting the balls covering each grid vertex once per frame
+	OCCUPANCY_FIELD,
+	// Summing a compact metaball kernel at each grid vertex so nearby blobs merge
+	METABALL_FIELD
+} ClassificationMode;
+
+class Ball {
+	private:
+		float radius;
+		float speed;
+		vec3 position;
+		vec3 facing;
+		vec4 color;
+		bool outOfBounds;
+
+	public:
+		Ball(float radius, float speed = 3.0f, vec3 position = vec3{ 0.0f, 0.0f, 0.0f },
+			vec3 facing = vec3{ 1.0f, 1.0f, 0.0f }, vec4 color = vec4{ 1.0f, 1.0f, 1.0f });
+		bool contains(vec3 point);
+		void move();
+		void bounce(const vec3 &normal);
+		void setSpeed(float speed);
+		float getSpeed();
+		float getRadius();
+		vec3 getPosition();
+		void setPosition(const vec3 &position);
+		vec3 getFacing();
+		vec4 getColor();
+		bool isOutOfBounds();
+		void setOutOfBounds();
+		void clearOutOfBounds();
+};
+
+class SceneBounds {
+	private:
+		float maxX;
+		float minX;
+		float maxY;
+		float minY;
+
+	public:
+		SceneBounds(float maxX, float minX, float maxY, float minY);
+		bool outOfBounds(Ball &ball);
+		vec3 getWallNormal(Ball &ball);
+		vec3 getWallNormal(float x, float y, float radius);
+		float getMaxX();
+		float getMinX();
+		float getMaxY();
+		float getMinY();
+};
+
+// A ball's place in the collision sweep, its horizontal band and x extent
+typedef struct SweepEntry {
+	int band;
+	float left;
+	float right;
+	unsigned int ball;
+} SweepEntry;
+
+// Balls stored one array per field, so a step moves and wall tests all of
+// them in one vector pass. Only balls that hit a wall are then visited one by
+// one, in order, to pick new facings. Colors are indices into a palette of
+// the store's own. Ball remains the type for adding or copying out one ball.
+// Collisions between balls are found by sweep and prune along x within bands
+// of y, keeping the sweep order between steps so re-sorting is close to linear.
+class BallStore {
+	private:
+		std::vector<float> xs;
+		std::vector<float> ys;
+		std::vector<float> facingXs;
+		std::vector<float> facingYs;
+		std::vector<float> speeds;
+		std::vector<float> radii;
+		std::vector<unsigned char> colorIndices;
+		// Set for the step a ball crosses a wall, so it only turns once
+		std::vector<unsigned char> escaped;
+		std::vector<vec4> palette;
+
+		// Balls ordered by band and left edge as of the last collide
+		std::vector<SweepEntry> sweep;
+		size_t pairTests;
+		size_t contacts;
+
+		void testContact(unsigned int a, unsigned int b);
+		void resolveContact(unsigned int a, unsigned int b);
+
+	public:
+		BallStore();
+		void clear();
+		void reserve(size_t count);
+		void add(const Ball &ball);
+		int move(SceneBounds &bounds, const ClassifyKernels &kernels);
+		void bounce(SceneBounds &bounds, int flagged);
+		void collide();
+		size_t getPairTests();
+		size_t getContacts();
+		size_t size();
+		bool empty();
+		Ball get(unsigned int ball);
+		vec3 getPosition(unsigned int ball);
+		void setPosition(unsigned int ball, const vec3 &position);
+		float getX(unsigned int ball);
+		float getY(unsigned int ball);
+		const float* getXs();
+		const float* getYs();
+		float getRadius(unsigned int ball);
+		void setSpeed(unsigned int ball, float speed);
+		vec4 getColor(unsigned int ball);
+		unsigned char getColorIndex(unsigned int ball);
+		const std::vector<vec4>& getPalette();
+};
+
+// How point location turns distances into squares, picked once per grid
+typedef enum WidthKind {
+	// Dividing by the square width
+	WIDTH_ANY,
+	// Multiplying by its reciprocal, which is exact for powers of two
+	WIDTH_POWER_OF_TWO,
+	// Squares one unit wide, distances already are squares
+	WIDTH_UNIT
+} WidthKind;
+
+// Grid extent and spacing as of the last populateGrid, with what the
+// specialized paths need worked out up front
+typedef struct GridGeometry {
+	float extent;
+	float width;
+	float inverseWidth;
+	int rows;
+	int cols;
+	// log2 of cols when it is a power of two, -1 otherwise
+	int colShift;
+	WidthKind widthKind;
+} GridGeometry;
+
+typedef void (*LocateSquaresFunction)(const GridGeometry &geometry, const float *xs, const float *ys, int *squares, size_t count);
+
+// A block of squares classified by one task. The tile owns its squares and
+// their top left vertices, plus the outer vertex row and column along the
+// grid's bottom and right edges, so no two tiles write the same cell.
+typedef struct SquareTile {
+	GridWindow squares;
+	// Squares activated this frame, merged into the active set in tile order
+	std::vector<int> active;
+	size_t duplicates;
+	// Owned vertices written into the field last frame
+	GridWindow touched;
+	bool queued;
+	// The tile's squares and vertices in a sparse grid, NULL while it has none
+	GridChunk *chunk;
+} SquareTile;
+
+// Where a tile's squares and vertices live, either the whole grid's arrays or
+// the tile's chunk. Rows are offset by top and columns by left, so both are
+// indexed with grid rows and columns.
+typedef struct TileStorage {
+	int top;
+	int left;
+	unsigned char *states;
+	unsigned char *colors;
+	int squareStride;
+	float *field;
+	unsigned char *fieldColors;
+	int vertexStride;
+} TileStorage;
+
+// A square whose case, or color while occupied, changed during the last frame
+typedef struct SquareDelta {
+	int square;
+	unsigned char before;
+	unsigned char after;
+	// Palette index of the square after the change
+	unsigned char color;
+} SquareDelta;
+
+// Owns the grid, the balls and the per-frame classification. The viewer
+// and the headless tools drive it one frame at a time through step().
+// Squares are addressed by their row major index, row * cols + col.
+class MarchingSquaresEngine {
+	private:
+		float dimension;
+		float squareWidth;
+		int rows;
+		int cols;
+		// Extent and width asked for through setGeometry, applied by populateGrid
+		float requestedDimension;
+		float requestedWidth;
+		GridGeometry geometry;
+		// locateSquares instance specialized for the grid's width and column count
+		LocateSquaresFunction locateKernel;
+
+		// One case byte and one palette index per square, corners are derived from the index
+		std::vector<unsigned char> states;
+		std::vector<unsigned char> colors;
+		std::vector<vec4> palette;
+		// Each ball's entry in palette, mapped from the ball store's own palette each frame
+		std::vector<unsigned char> ballColors;
+		std::vector<unsigned char> storeColors;
+
+		ActiveSquareSet activeSquares;
+		BallStore balls;
+		SceneBounds sceneBounds;
+		int centerSquare;
+		// Square under each ball's center in the corner mode, NULL_SQUARE off the grid
+		std::vector<int> epicenters;
+		ClassificationMode mode;
+
+		// Per-vertex field, (rows + 1) x (cols + 1), and the color of the ball that last touched each vertex
+		std::vector<float> field;
+		std::vector<unsigned char> fieldColors;
+		int fieldCols;
+		int fieldTop;
+		int fieldLeft;
+		int fieldBottom;
+		int fieldRight;
+		const ClassifyKernels *kernels;
+		// Set when the field was last written tile by tile
+		bool fieldTiled;
+		// Set when the last field pass found few active squares in its box
+		bool fieldSparse;
+
+		// Tiled classification, used with more than one thread or a sparse field
+		std::unique_ptr<ThreadPool> pool;
+		std::vector<SquareTile> tiles;
+		int tileRows;
+		int tileCols;
+		std::vector<int> queuedTiles;
+		std::vector<int> fieldTiles;
+		// Each ball's squares in the corner mode, or vertices in the field modes
+		std::vector<GridWindow> windows;
+		// Squares each ball can change, binned into tile sized buckets
+		std::vector<GridWindow> reaches;
+		SpatialHash ballHash;
+		// Windows and buckets of the last tiled field pass, so tiles can clear just what they wrote
+		std::vector<GridWindow> writtenWindows;
+		SpatialHash writtenHash;
+
+		// A sparse grid only gives chunks to tiles with something in them, one
+		// each, though every tile keeps its entry in tiles and in the ball
+		// hashes. Requests take effect at the next populateGrid.
+		bool sparse;
+		bool sparseRequested;
+		ChunkPool chunkPool;
+		std::vector<int> chunkedTiles;
+		// Frame counter the chunks' square stamps are compared against
+		unsigned int chunkGeneration;
+
+		// The adaptive corner pass fills or skips whole blocks, testing corners only along the ball's edge
+		bool adaptive;
+
+		// Balls bounce off each other as well as the walls
+		bool collisions;
+
+		// Stage timings and counters of the last frame, only kept up while enabled
+		bool statsEnabled;
+		FrameStats stats;
+
+		// Incremental classification keeps cases across frames and only redoes cells near moving balls
+		bool incremental;
+		bool incrementalReady;
+		std::vector<vec3> previousPositions;
+		std::vector<float> previousRadii;
+		std::vector<unsigned char> previousColors;
+		std::vector<GridWindow> previousWindows;
+		DirtyRegion dirtySquares;
+		DirtyRegion dirtyVertices;
+		std::vector<unsigned char> savedStates;
+		std::vector<unsigned char> savedColors;
+		std::vector<SquareDelta> savedSquares;
+		std::vector<SquareDelta> deltas;
+
+		bool allocateField();
+		void clearField(const TileStorage &storage, const GridWindow &region);
+		void accumulateField();
+		void resolveFieldStates();
+		void resolveFieldRows(const GridWindow &region, SquareTile *tile);
+		void resolveWindow(unsigned int ball, const GridWindow &window, SquareTile *tile, bool record = true);
+		void resolveBlock(unsigned int ball, const GridWindow &window, SquareTile *tile, bool record);
+		void fillWindow(unsigned int ball, const GridWindow &window, SquareTile *tile, bool record);
+		void recordSquare(int row, int col, SquareTile *tile);
+		GridWindow cornerWindow(unsigned int ball, int square);
+		GridWindow vertexWindow(unsigned int ball);
+		void buildTiles();
+		void queueTile(int tile);
+		void binBalls();
+		void classifyTiles();
+		void runTiles(const std::function<void(int)> &body);
+		void clearTileField(int tile, const GridWindow &owned);
+		void accumulateTileField(int tile);
+		void resolveTileField(int tile);
+		void resolveTileCorners(int tile);
+		void acquireChunks();
+		void releaseChunks(bool all);
+		TileStorage tileStorage(const SquareTile *tile);
+		SquareTile* squareTile(int square);
+		GridWindow ballWindow(unsigned int ball);
+		unsigned char fieldColor(const TileStorage &storage, int row, int col, int state);
+		void locateBalls();
+		void classifyAll();
+		void classifyIncremental();
+		void rebuildIncremental();
+		void rememberBalls();
+		void saveDirtySquares();
+		void commitDirtySquares();
+		void resolveDirtyCorners();
+		void accumulateDirtyField();
+		void resolveDirtyField();
+		void activate(int square, unsigned char color, MarchingSquareState state);
+		unsigned char paletteIndex(const vec4 &color);
+
+	public:
+		MarchingSquaresEngine(float dimension = DIMENSION, float squareWidth = SQUARE_WIDTH);
+		void setGeometry(float dimension, float squareWidth);
+		bool populateGrid();
+		void generateShapes(int numShapes);
+		void generateShapes(int numShapes, int minRadius, int maxRadius);
+		void moveBalls();
+		void classify();
+		void step();
+		void clearActiveSquares();
+		int findSquare(const vec3 &pos);
+		int locateSquare(float x, float y);
+		void locateSquares(const float *xs, const float *ys, int *squares, size_t count);
+		void resolveSquareStates(unsigned int ball, int square);
+		void activateSquare(int square, unsigned char color, int state);
+		void emptyState(int square);
+		bool squareContains(int square, const vec3 &point);
+		vec3 topLeft(int square);
+		vec3 botLeft(int square);
+		vec3 botRight(int square);
+		vec3 topRight(int square);
+		vec3 getCenter(int square);
+		vec4 getColor(int square);
+		unsigned char getColorIndex(int square);
+		const std::vector<vec4>& getPalette();
+		MarchingSquareState getState(int square);
+		int getRow(int square);
+		int getCol(int square);
+		int getRows();
+		int getCols();
+		size_t getGridBytes();
+		static double estimateGridBytes(int rows, int cols, ClassificationMode mode, bool sparse = false);
+		void setKernelLevel(KernelLevel level);
+		const ClassifyKernels& getKernels();
+		void setThreadCount(unsigned int threadCount);
+		unsigned int getThreadCount();
+		void setIncremental(bool incremental);
+		bool isIncremental();
+		const std::vector<SquareDelta>& getDeltas();
+		void setAdaptive(bool adaptive);
+		bool isAdaptive();
+		void setCollisions(bool collisions);
+		bool isColliding();
+		void setStatsEnabled(bool enabled);
+		bool isStatsEnabled();
+		const FrameStats& getStats();
+		void setSparseGrid(bool sparse);
+		bool isSparseGrid();
+		size_t getChunkCount();
+		void setClassificationMode(ClassificationMode mode);
+		ClassificationMode getClassificationMode();
+		float getFieldThreshold();
+		float getDimension();
+		float getSquareWidth();
+		const GridGeometry& getGeometry();
+		ActiveSquareSet& getActiveSquares();
+		BallStore& getBalls();
+		int getCenterSquare();
+};
+
+Direction generateDirection();
+vec3 bounceDirection(const vec3 &normal);
+bool parseClassificationMode(const char *name, ClassificationMode &mode);
+bool parseRadiusRange(const char *text, int &minRadius, int &maxRadius);
+
+//////////////////
+// Lookup Tables
+//////////////
+
+extern vec3 directionsLookup[];
+extern vec4 shapeColors[];
+
+#endif
@@ -0,0 +1,425 @@
+/*
+	Marching Squares - Mesh Builder
+	Flattens a frame's active squares into one vertex array of triangles
+	and one of outline segments, ready for a single draw call each, into
+	per-case instance records drawn against fixed case templates, or into
+	an indexed mesh sharing every corner and edge point between squares.
+	Nothing in here depends on OpenGL, so it runs in the headless tools too.
+*/
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "meshBuilder.h"
+
+#ifndef PI
+	#define PI 3.14159265358979323846
+#endif
+
+typedef MeshVertex* (*CaseEmitter)(MeshVertex *out, const vec3 &position, float half, const unsigned char color[4]);
+
+// Writes one case's triangles scaled by half a square width and offset to
+// position, returning the next free vertex. Each instance's template and
+// vertex count are constants, so the loop unrolls into straight stores.
+template<int state>
+static MeshVertex* emitCase(MeshVertex *out, const vec3 &position, float half, const unsigned char color[4]) {
+	const int first = CASE_OFFSETS.first[state];
+	// Local copies, otherwise every store into out could overwrite them
+	vec3 origin = position;
+	float scale = half;
+	unsigned char rgba[4] = { color[0], color[1], color[2], color[3] };
+
+	for (int v = 0; v < CASE_VERTEX_COUNTS[state]; v++) {
+		out[v].x = CASE_POINTS[first + v].x * scale + origin.x;
+		out[v].y = CASE_POINTS[first + v].y * scale + origin.y;
+		out[v].z = CASE_POINTS[first + v].z + origin.z;
+		out[v].color[0] = rgba[0];
+		out[v].color[1] = rgba[1];
+		out[v].color[2] = rgba[2];
+		out[v].color[3] = rgba[3];
+	}
+
+	return out + CASE_VERTEX_COUNTS[state];
+}
+
+static const CaseEmitter caseEmitters[CASE_COUNT] = {
+	emitCase<0>, emitCase<1>, emitCase<2>, emitCase<3>, emitCase<4>, emitCase<5>, emitCase<6>, emitCase<7>,
+	emitCase<8>, emitCase<9>, emitCase<10>, emitCase<11>, emitCase<12>, emitCase<13>, emitCase<14>, emitCase<15>
+};
+
+//////////////////////
+// class: MeshBuilder
+//////////////////
+
+MeshBuilder::MeshBuilder() {
+	weldBase = 0;
+	clear();
+}
+
+// Empties every array, keeping their storage for the next frame
+void MeshBuilder::clear() {
+	triangles.clear();
+	lines.clear();
+	instances.clear();
+	weldedVertices.clear();
+	indices.clear();
+
+	for (int c = 0; c < CASE_COUNT; c++) {
+		caseFirst[c] = 0;
+		caseCount[c] = 0;
+	}
+}
+
+// Appends the case triangles of every active square, offset to the square and in its color
+void MeshBuilder::addSquares(MarchingSquaresEngine &engine) {
+	const std::vector<int> &squares = engine.getActiveSquares().getSquares();
+	size_t first = triangles.size();
+	size_t count = 0;
+
+	// Sizing the array once up front so the fill below is plain stores
+	for (unsigned int i = 0; i < squares.size(); i++) {
+		count += CASE_VERTEX_COUNTS[engine.getState(squares[i])];
+	}
+
+	triangles.resize(first + count);
+	MeshVertex *out = triangles.data() + first;
+	// Templates span -1 to 1, a whole square is two half widths
+	float half = engine.getSquareWidth() / 2.0f;
+
+	packPalette(engine);
+
+	for (unsigned int i = 0; i < squares.size(); i++) {
+		int square = squares[i];
+		const unsigned char *color = &packedPalette[engine.getColorIndex(square) * 4];
+
+		out = caseEmitters[engine.getState(square)](out, engine.topLeft(square), half, color);
+	}
+}
+
+// Replaces the instance records with one per active square, grouped by case
+void MeshBuilder::addInstances(MarchingSquaresEngine &engine) {
+	const std::vector<int> &squares = engine.getActiveSquares().getSquares();
+	int cols = engine.getCols();
+
+	for (int c = 0; c < CASE_COUNT; c++) {
+		caseCount[c] = 0;
+	}
+
+	// Counting sort on the case, so each case's squares sit together for one draw
+	for (unsigned int i = 0; i < squares.size(); i++) {
+		caseCount[engine.getState(squares[i])]++;
+	}
+
+	int next[CASE_COUNT];
+	int total = 0;
+
+	for (int c = 0; c < CASE_COUNT; c++) {
+		caseFirst[c] = total;
+		next[c] = total;
+		total += caseCount[c];
+	}
+
+	instances.resize(total);
+
+	for (unsigned int i = 0; i < squares.size(); i++) {
+		int square = squares[i];
+		SquareInstance &instance = instances[next[engine.getState(square)]++];
+
+		instance.col = (unsigned short)(square % cols);
+		instance.row = (unsigned short)(square / cols);
+		packColor(engine.getColor(square), instance.color);
+	}
+}
+
+/*
+*  Replaces the indexed mesh with one built from the active squares. Squares
+*  are visited in row order so each grid corner and edge point is looked up
+*  in a slot array addressed by its column, two lattice rows at a time,
+*  instead of a hash. Points are only shared between squares of one color.
+*  Runs of FILLED squares of one color become a single quad.
+*/
+void MeshBuilder::addIndexedSquares(MarchingSquaresEngine &engine) {
+	int cols = engine.getCols();
+	// Templates span -1 to 1 across one square
+	float half = engine.getSquareWidth() / 2.0f;
+
+	prepareWelding(cols);
+	sortActiveSquares(engine);
+
+	weldedVertices.clear();
+	indices.clear();
+
+	int count = (int)sortedSquares.size();
+
+	for (int k = 0; k < count; k++) {
+		int square = sortedSquares[k];
+		int row = square / cols;
+		int col = square % cols;
+		int state = engine.getState(square);
+		vec3 center = engine.topLeft(square);
+		unsigned char color[4];
+
+		packColor(engine.getColor(square), color);
+
+		// Lattice rows above and below this square, tagged so no other row or frame matches
+		long long upperTag = weldBase + row;
+		long long lowerTag = upperTag + 1;
+		WeldSlot *upperCorners = &cornerSlots[(row & 1) * (cols + 1)];
+		WeldSlot *lowerCorners = &cornerSlots[((row + 1) & 1) * (cols + 1)];
+
+		if (state == FILLED) {
+			int last = col;
+
+			// Extending over the FILLED squares of the same color to the right
+			while (k + 1 < count && last + 1 < cols && sortedSquares[k + 1] == square + (last - col) + 1) {
+				unsigned char next[4];
+				int neighbour = sortedSquares[k + 1];
+
+				packColor(engine.getColor(neighbour), next);
+
+				if (engine.getState(neighbour) != FILLED || memcmp(next, color, 4) != 0) {
+					break;
+				}
+
+				k++;
+				last++;
+			}
+
+			float z = center.z + CASE_POINTS[CASE_OFFSETS.first[FILLED]].z;
+			float right = center.x + (last - col) * 2.0f * half + half;
+			unsigned int topLeft = weldPoint(upperCorners[col], upperTag, vec3{ center.x - half, center.y + half, z }, color);
+			unsigned int topRight = weldPoint(upperCorners[last + 1], upperTag, vec3{ right, center.y + half, z }, color);
+			unsigned int botLeft = weldPoint(lowerCorners[col], lowerTag, vec3{ center.x - half, center.y - half, z }, color);
+			unsigned int botRight = weldPoint(lowerCorners[last + 1], lowerTag, vec3{ right, center.y - half, z }, color);
+			unsigned int quad[6] = { topLeft, botLeft, botRight, botRight, topRight, topLeft };
+
+			indices.insert(indices.end(), quad, quad + 6);
+			continue;
+		}
+
+		for (int v = CASE_OFFSETS.first[state]; v < CASE_OFFSETS.first[state + 1]; v++) {
+			const CasePoint &point = CASE_POINTS[v];
+			int site = CASE_SITES.site[v] >> 2;
+			int slot = CASE_SITES.site[v] & 3;
+			vec3 position = vec3{ center.x + point.x * half, center.y + point.y * half, center.z + point.z };
+			unsigned int vertex;
+
+			switch (site) {
+				case WELD_CORNER:
+					vertex = weldPoint(slot < 2 ? upperCorners[col + slot] : lowerCorners[col + slot - 2],
+						slot < 2 ? upperTag : lowerTag, position, color);
+					break;
+				case WELD_TOP_EDGE:
+					vertex = weldPoint(rowEdgeSlots[(row & 1) * 3 * cols + 3 * col + slot], upperTag, position, color);
+					break;
+				case WELD_BOTTOM_EDGE:
+					vertex = weldPoint(rowEdgeSlots[((row + 1) & 1) * 3 * cols + 3 * col + slot], lowerTag, position, color);
+					break;
+				case WELD_LEFT_EDGE:
+					vertex = weldPoint(colEdgeSlots[3 * col + slot], upperTag, position, color);
+					break;
+				case WELD_RIGHT_EDGE:
+					vertex = weldPoint(colEdgeSlots[3 * (col + 1) + slot], upperTag, position, color);
+					break;
+				default:
+					vertex = (unsigned int)weldedVertices.size();
+					weldedVertices.push_back(MeshVertex{ position.x, position.y, position.z,
+						{ color[0], color[1], color[2], color[3] } });
+					break;
+			}
+
+			indices.push_back(vertex);
+		}
+	}
+
+	// Every tag used this frame falls below the next frame's base
+	weldBase += engine.getRows() + 2;
+}
+
+void MeshBuilder::addSquareOutlines(MarchingSquaresEngine &engine) {
+	const std::vector<int> &squares = engine.getActiveSquares().getSquares();
+
+	lines.reserve(lines.size() + squares.size() * 8);
+
+	for (unsigned int i = 0; i < squares.size(); i++) {
+		addSquareOutline(engine, squares[i]);
+	}
+}
+
+// Four white segments around the square's edges
+void MeshBuilder::addSquareOutline(MarchingSquaresEngine &engine, int square) {
+	const unsigned char white[4] = { 255, 255, 255, 255 };
+	vec3 topLeft = engine.topLeft(square);
+	vec3 botLeft = engine.botLeft(square);
+	vec3 botRight = engine.botRight(square);
+	vec3 topRight = engine.topRight(square);
+
+	addLine(topLeft, botLeft, white);
+	addLine(botLeft, botRight, white);
+	addLine(botRight, topRight, white);
+	addLine(topRight, topLeft, white);
+}
+
+// White outline of a ball, CIRCLE_SEGMENTS segments around its center
+void MeshBuilder::addCircle(const vec3 &center, float radius) {
+	const unsigned char white[4] = { 255, 255, 255, 255 };
+	vec3 previous = vec3{ center.x + radius, center.y, 0.0f };
+
+	for (int i = 1; i <= CIRCLE_SEGMENTS; i++) {
+		double theta = 2.0 * PI * i / CIRCLE_SEGMENTS;
+		vec3 next = vec3{ center.x + (float)cos(theta) * radius, center.y + (float)sin(theta) * radius, 0.0f };
+
+		addLine(previous, next, white);
+		previous = next;
+	}
+}
+
+const std::vector<MeshVertex>& MeshBuilder::getTriangles() {
+	return triangles;
+}
+
+const std::vector<MeshVertex>& MeshBuilder::getLines() {
+	return lines;
+}
+
+const std::vector<SquareInstance>& MeshBuilder::getInstances() {
+	return instances;
+}
+
+int MeshBuilder::getCaseFirst(int state) {
+	return caseFirst[state];
+}
+
+int MeshBuilder::getCaseCount(int state) {
+	return caseCount[state];
+}
+
+const std::vector<MeshVertex>& MeshBuilder::getWeldedVertices() {
+	return weldedVertices;
+}
+
+const std::vector<unsigned int>& MeshBuilder::getIndices() {
+	return indices;
+}
+
+// Triangles of the squares in whichever forms were built, instances counted by their case templates
+size_t MeshBuilder::getTriangleCount() {
+	size_t vertices = triangles.size() + indices.size();
+
+	for (int c = 0; c < CASE_COUNT; c++) {
+		vertices += (size_t)caseCount[c] * CASE_VERTEX_COUNTS[c];
+	}
+
+	return vertices / 3;
+}
+
+size_t MeshBuilder::getBytes() {
+	return (triangles.capacity() + lines.capacity() + weldedVertices.capacity()) * sizeof(MeshVertex)
+		+ instances.capacity() * sizeof(SquareInstance) + indices.capacity() * sizeof(unsigned int);
+}
+
+// Radix sorts the active squares by index, which puts them in row order
+void MeshBuilder::sortActiveSquares(MarchingSquaresEngine &engine) {
+	const std::vector<int> &squares = engine.getActiveSquares().getSquares();
+	std::vector<int> counts(1 << 16);
+
+	sortedSquares.assign(squares.begin(), squares.end());
+	sortScratch.resize(squares.size());
+
+	// Two passes of 16 bits cover any grid with fewer than 2^31 squares
+	for (int shift = 0; shift < 32; shift += 16) {
+		std::fill(counts.begin(), counts.end(), 0);
+
+		for (unsigned int i = 0; i < sortedSquares.size(); i++) {
+			counts[(sortedSquares[i] >> shift) & 0xFFFF]++;
+		}
+
+		int total = 0;
+		for (unsigned int d = 0; d < counts.size(); d++) {
+			int digits = counts[d];
+			counts[d] = total;
+			total += digits;
+		}
+
+		for (unsigned int i = 0; i < sortedSquares.size(); i++) {
+			sortScratch[counts[(sortedSquares[i] >> shift) & 0xFFFF]++] = sortedSquares[i];
+		}
+
+		sortedSquares.swap(sortScratch);
+	}
+}
+
+// Packs every palette entry once, rather than every square's color
+void MeshBuilder::packPalette(MarchingSquaresEngine &engine) {
+	const std::vector<vec4> &palette = engine.getPalette();
+
+	packedPalette.resize(palette.size() * 4);
+
+	for (unsigned int i = 0; i < palette.size(); i++) {
+		packColor(palette[i], &packedPalette[i * 4]);
+	}
+}
+
+// Sizes the slot arrays for the grid
+void MeshBuilder::prepareWelding(int cols) {
+	const WeldSlot unused = { 0, -1 };
+
+	if ((int)colEdgeSlots.size() != 3 * (cols + 1)) {
+		cornerSlots.assign(2 * (cols + 1), unused);
+		rowEdgeSlots.assign(2 * 3 * cols, unused);
+		colEdgeSlots.assign(3 * (cols + 1), unused);
+	}
+}
+
+// Returns the vertex already in slot if it was made this frame in the same color, otherwise a new one
+unsigned int MeshBuilder::weldPoint(WeldSlot &slot, long long tag, const vec3 &position, const unsigned char color[4]) {
+	if (slot.tag == tag && memcmp(weldedVertices[slot.vertex].color, color, 4) == 0) {
+		return slot.vertex;
+	}
+
+	MeshVertex vertex = { position.x, position.y, position.z, { color[0], color[1], color[2], color[3] } };
+	unsigned int index = (unsigned int)weldedVertices.size();
+
+	weldedVertices.push_back(vertex);
+
+	// A differently colored neighbour keeps the point it made first
+	if (slot.tag != tag) {
+		slot.vertex = index;
+		slot.tag = tag;
+	}
+
+	return index;
+}
+
+void MeshBuilder::addLine(const vec3 &from, const vec3 &to, const unsigned char color[4]) {
+	MeshVertex a = { from.x, from.y, from.z, { color[0], color[1], color[2], color[3] } };
+	MeshVertex b = { to.x, to.y, to.z, { color[0], color[1], color[2], color[3] } };
+
+	lines.push_back(a);
+	lines.push_back(b);
+}
+
+// Converts a 0 to 1 float color to bytes
+void packColor(const vec4 &color, unsigned char out[4]) {
+	const float channels[4] = { color.x, color.y, color.z, color.w };
+
+	for (int i = 0; i < 4; i++) {
+		float c = channels[i] < 0.0f ? 0.0f : (channels[i] > 1.0f ? 1.0f : channels[i]);
+		out[i] = (unsigned char)(c * 255.0f + 0.5f);
+	}
+}
+
+// Copies CASE_POINTS into one position array, relative to a square's top left
+void buildCaseTemplates(std::vector<float> &positions, int first[CASE_COUNT], int count[CASE_COUNT]) {
+	positions.clear();
+
+	for (int c = 0; c < CASE_COUNT; c++) {
+		first[c] = CASE_OFFSETS.first[c];
+		count[c] = CASE_VERTEX_COUNTS[c];
+	}
+
+	for (int v = 0; v < CASE_POINT_COUNT; v++) {
+		positions.insert(positions.end(), { CASE_POINTS[v].x, CASE_POINTS[v].y, CASE_POINTS[v].z });
+	}
+}
@@ -0,0 +1,99 @@
+/*
+	Marching Squares - Mesh Builder
+	Flattens a frame's active squares into one vertex array of triangles
+	and one of outline segments, ready for a single draw call each, into
+	per-case instance records drawn against fixed case templates, or into
+	an indexed mesh sharing every corner and edge point between squares.
+	Nothing in here depends on OpenGL, so it runs in the headless tools too.
+*/
+
+#ifndef MESH_BUILDER_H
+#define MESH_BUILDER_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "caseTable.h"
+#include "marchingSquaresEngine.h"
+
+// Interleaved position and RGBA color, 16 bytes per vertex
+typedef struct MeshVertex {
+	float x;
+	float y;
+	float z;
+	unsigned char color[4];
+} MeshVertex;
+
+// One square drawn from its case's template, 8 bytes. populateGrid keeps
+// every grid within MAX_GRID_SIDE, so columns and rows fit in 16 bits.
+typedef struct SquareInstance {
+	unsigned short col;
+	unsigned short row;
+	unsigned char color[4];
+} SquareInstance;
+
+static_assert(MAX_GRID_SIDE <= 65535, "instance columns and rows must fit an unsigned short");
+
+// Number of segments approximating a ball's outline
+const int CIRCLE_SEGMENTS = 24;
+
+// The vertex created for one grid corner or edge point, valid while tag matches
+typedef struct WeldSlot {
+	unsigned int vertex;
+	long long tag;
+} WeldSlot;
+
+// Vertices are written already translated into grid space and colored, so
+// the whole mesh draws under one transform. Storage is kept between frames.
+class MeshBuilder {
+	private:
+		std::vector<MeshVertex> triangles;
+		// The engine's palette packed to bytes, four per entry
+		std::vector<unsigned char> packedPalette;
+		std::vector<MeshVertex> lines;
+		// Grouped by case, case c starts at caseFirst[c]
+		std::vector<SquareInstance> instances;
+		int caseFirst[CASE_COUNT];
+		int caseCount[CASE_COUNT];
+
+		// Indexed mesh, walked in row order with two rows of slots rolling down the grid
+		std::vector<MeshVertex> weldedVertices;
+		std::vector<unsigned int> indices;
+		std::vector<int> sortedSquares;
+		std::vector<int> sortScratch;
+		std::vector<WeldSlot> cornerSlots;
+		std::vector<WeldSlot> rowEdgeSlots;
+		std::vector<WeldSlot> colEdgeSlots;
+		// Added to lattice rows to make slot tags unique across frames
+		long long weldBase;
+
+		void addLine(const vec3 &from, const vec3 &to, const unsigned char color[4]);
+		void sortActiveSquares(MarchingSquaresEngine &engine);
+		void prepareWelding(int cols);
+		void packPalette(MarchingSquaresEngine &engine);
+		unsigned int weldPoint(WeldSlot &slot, long long tag, const vec3 &position, const unsigned char color[4]);
+
+	public:
+		MeshBuilder();
+		void clear();
+		void addSquares(MarchingSquaresEngine &engine);
+		void addInstances(MarchingSquaresEngine &engine);
+		void addIndexedSquares(MarchingSquaresEngine &engine);
+		void addSquareOutlines(MarchingSquaresEngine &engine);
+		void addSquareOutline(MarchingSquaresEngine &engine, int square);
+		void addCircle(const vec3 &center, float radius);
+		const std::vector<MeshVertex>& getTriangles();
+		const std::vector<MeshVertex>& getLines();
+		const std::vector<SquareInstance>& getInstances();
+		const std::vector<MeshVertex>& getWeldedVertices();
+		const std::vector<unsigned int>& getIndices();
+		int getCaseFirst(int state);
+		int getCaseCount(int state);
+		size_t getTriangleCount();
+		size_t getBytes();
+};
+
+void packColor(const vec4 &color, unsigned char out[4]);
+void buildCaseTemplates(std::vector<float> &positions, int first[CASE_COUNT], int count[CASE_COUNT]);
+
+#endif
@@ -0,0 +1,247 @@
+/*
+	Marching Squares - Mesh Builder Test
+	Builds every frame's mesh all three ways from one engine state and checks
+	they draw the same thing. Instances expanded against the case templates,
+	as the instanced shader does, must give exactly the batched triangles.
+	The indexed mesh must give the same triangles too, except where it merges
+	runs of FILLED squares into quads, which must cover the same area in the
+	same colors. Exits with 1 on the first frame that differs.
+
+	Usage: meshBuilderTest [--frames N] [--seed N]
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <vector>
+
+#include "meshBuilder.h"
+
+const int DEFAULT_FRAMES = 40;
+const unsigned int DEFAULT_SEED = 1;
+const int GRID_SIZE = 129;
+const int BALLS = 12;
+// Template points sit on tenths of a half square, so positions are compared in those units
+const float POINT_STEPS = 10.0f;
+const float WIDTHS[] = { 2.0f, 1.0f, 0.5f, 0.25f };
+const int WIDTH_COUNT = sizeof(WIDTHS) / sizeof(WIDTHS[0]);
+const ClassificationMode MODES[] = { CORNER_TESTS, OCCUPANCY_FIELD, METABALL_FIELD };
+const int MODE_COUNT = sizeof(MODES) / sizeof(MODES[0]);
+
+// A triangle snapped to the point grid, rotated to start at its smallest vertex so winding is kept
+typedef struct TriangleKey {
+	long long points[3][3];
+	unsigned int color;
+
+	bool operator<(const TriangleKey &other) const {
+		if (color != other.color) {
+			return color < other.color;
+		}
+
+		return memcmp(points, other.points, sizeof(points)) < 0;
+	}
+
+	bool operator==(const TriangleKey &other) const {
+		return color == other.color && memcmp(points, other.points, sizeof(points)) == 0;
+	}
+} TriangleKey;
+
+static TriangleKey makeKey(const MeshVertex &a, const MeshVertex &b, const MeshVertex &c, float half) {
+	const MeshVertex *vertices[3] = { &a, &b, &c };
+	long long points[3][3];
+	TriangleKey key;
+
+	for (int v = 0; v < 3; v++) {
+		points[v][0] = llroundf(vertices[v]->x * POINT_STEPS / half);
+		points[v][1] = llroundf(vertices[v]->y * POINT_STEPS / half);
+		points[v][2] = llroundf(vertices[v]->z);
+	}
+
+	int first = 0;
+	for (int v = 1; v < 3; v++) {
+		if (memcmp(points[v], points[first], sizeof(points[v])) < 0) {
+			first = v;
+		}
+	}
+
+	for (int v = 0; v < 3; v++) {
+		memcpy(key.points[v], points[(first + v) % 3], sizeof(key.points[v]));
+	}
+
+	memcpy(&key.color, a.color, sizeof(key.color));
+
+	return key;
+}
+
+// Twice the triangle's area in point grid units, exact
+static long long doubleArea(const TriangleKey &key) {
+	long long area = (key.points[1][0] - key.points[0][0]) * (key.points[2][1] - key.points[0][1])
+		- (key.points[2][0] - key.points[0][0]) * (key.points[1][1] - key.points[0][1]);
+
+	return area < 0 ? -area : area;
+}
+
+// Expands the instance records the way the instanced shader places them
+static void expandInstances(MeshBuilder &mesh, MarchingSquaresEngine &engine, std::vector<MeshVertex> &out) {
+	const std::vector<SquareInstance> &instances = mesh.getInstances();
+	float width = engine.getSquareWidth();
+	float half = width / 2.0f;
+	float dimension = engine.getDimension();
+
+	out.clear();
+
+	for (int c = 0; c < CASE_COUNT; c++) {
+		for (int i = mesh.getCaseFirst(c); i < mesh.getCaseFirst(c) + mesh.getCaseCount(c); i++) {
+			const SquareInstance &instance = instances[i];
+			vec3 topLeft = vec3{ instance.col * width - dimension, dimension - instance.row * width, -1.0f };
+
+			for (int v = CASE_OFFSETS.first[c]; v < CASE_OFFSETS.first[c + 1]; v++) {
+				out.push_back(MeshVertex{ CASE_POINTS[v].x * half + topLeft.x, CASE_POINTS[v].y * half + topLeft.y,
+					CASE_POINTS[v].z + topLeft.z, { instance.color[0], instance.color[1], instance.color[2], instance.color[3] } });
+			}
+		}
+	}
+}
+
+static void collectTriangles(const std::vector<MeshVertex> &vertices, float half, std::vector<TriangleKey> &keys) {
+	keys.clear();
+
+	for (size_t v = 0; v + 2 < vertices.size(); v += 3) {
+		keys.push_back(makeKey(vertices[v], vertices[v + 1], vertices[v + 2], half));
+	}
+
+	std::sort(keys.begin(), keys.end());
+}
+
+// Returns a description of the first difference, or NULL if the three meshes agree
+static const char* compareMeshes(MeshBuilder &mesh, MarchingSquaresEngine &engine, std::vector<MeshVertex> &scratch) {
+	float half = engine.getSquareWidth() / 2.0f;
+	const std::vector<int> &squares = engine.getActiveSquares().getSquares();
+	std::vector<TriangleKey> batched;
+	std::vector<TriangleKey> instanced;
+	std::vector<TriangleKey> filled;
+	std::vector<TriangleKey> indexed;
+
+	collectTriangles(mesh.getTriangles(), half, batched);
+	expandInstances(mesh, engine, scratch);
+	collectTriangles(scratch, half, instanced);
+
+	if (batched != instanced) {
+		return "instanced triangles differ from batched";
+	}
+
+	// Batched triangles come out square by square in active set order
+	const std::vector<MeshVertex> &triangles = mesh.getTriangles();
+	size_t next = 0;
+
+	for (unsigned int i = 0; i < squares.size(); i++) {
+		int state = engine.getState(squares[i]);
+
+		if (state == FILLED) {
+			for (int v = 0; v < CASE_VERTEX_COUNTS[FILLED]; v += 3) {
+				filled.push_back(makeKey(triangles[next + v], triangles[next + v + 1], triangles[next + v + 2], half));
+			}
+		}
+
+		next += CASE_VERTEX_COUNTS[state];
+	}
+
+	const std::vector<MeshVertex> &welded = mesh.getWeldedVertices();
+	const std::vector<unsigned int> &indices = mesh.getIndices();
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		indexed.push_back(makeKey(welded[indices[i]], welded[indices[i + 1]], welded[indices[i + 2]], half));
+	}
+
+	std::sort(filled.begin(), filled.end());
+	std::sort(indexed.begin(), indexed.end());
+
+	// Triangles only one side has must be FILLED squares on the batched side and merged quads on the indexed side
+	std::vector<TriangleKey> batchedOnly;
+	std::vector<TriangleKey> indexedOnly;
+
+	std::set_difference(batched.begin(), batched.end(), indexed.begin(), indexed.end(), std::back_inserter(batchedOnly));
+	std::set_difference(indexed.begin(), indexed.end(), batched.begin(), batched.end(), std::back_inserter(indexedOnly));
+
+	std::vector<TriangleKey> unfilled;
+	std::set_difference(batchedOnly.begin(), batchedOnly.end(), filled.begin(), filled.end(), std::back_inserter(unfilled));
+
+	if (!unfilled.empty()) {
+		return "indexed mesh is missing a partial square's triangle";
+	}
+
+	std::map<unsigned int, long long> area;
+
+	for (unsigned int i = 0; i < batchedOnly.size(); i++) {
+		area[batchedOnly[i].color] += doubleArea(batchedOnly[i]);
+	}
+
+	for (unsigned int i = 0; i < indexedOnly.size(); i++) {
+		area[indexedOnly[i].color] -= doubleArea(indexedOnly[i]);
+	}
+
+	for (std::map<unsigned int, long long>::iterator it = area.begin(); it != area.end(); ++it) {
+		if (it->second != 0) {
+			return "indexed quads cover a different area than the FILLED squares";
+		}
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[]) {
+	int frames = DEFAULT_FRAMES;
+	unsigned int seed = DEFAULT_SEED;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frames = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			seed = static_cast<unsigned int>(strtoul(argv[++i], NULL, 10));
+		} else {
+			fprintf(stderr, "Usage: %s [--frames N] [--seed N]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	MeshBuilder mesh;
+	std::vector<MeshVertex> scratch;
+	size_t triangles = 0;
+
+	for (int w = 0; w < WIDTH_COUNT; w++) {
+		for (int m = 0; m < MODE_COUNT; m++) {
+			float width = WIDTHS[w];
+			MarchingSquaresEngine engine((GRID_SIZE - 1) * width / 2.0f, width);
+
+			srand(seed);
+			engine.setClassificationMode(MODES[m]);
+			engine.populateGrid();
+			engine.generateShapes(BALLS);
+
+			for (int frame = 0; frame < frames; frame++) {
+				engine.step();
+
+				mesh.clear();
+				mesh.addSquares(engine);
+				mesh.addInstances(engine);
+				mesh.addIndexedSquares(engine);
+
+				const char *difference = compareMeshes(mesh, engine, scratch);
+				if (difference != NULL) {
+					printf("width %g, mode %d, frame %d: %s\n", width, (int)MODES[m], frame, difference);
+					return 1;
+				}
+
+				triangles += mesh.getTriangles().size() / 3;
+			}
+		}
+	}
+
+	printf("widths: %d, modes: %d, frames: %d, triangles: %zu, all three meshes match\n", WIDTH_COUNT, MODE_COUNT, frames, triangles);
+
+	return 0;
+}
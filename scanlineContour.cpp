@@ -0,0 +1,261 @@
+/*
+	Marching Squares - Scanline Contour
+	Contours a raster of samples one row at a time, keeping only the two
+	vertex rows a row of squares needs, so memory follows the width alone.
+	Every sample is a grid vertex, and squares sit between four of them.
+*/
+
+#include <string.h>
+
+#include "mappedRaster.h"
+#include "marchingSquaresEngine.h"
+#include "scanlineContour.h"
+
+//////////////////////////
+// class: ScanlineContour
+//////////////////////
+
+ScanlineContour::ScanlineContour(int width, RasterType type, float threshold, ContourOutput output, FILE *out) {
+	this->width = width;
+	this->type = type;
+	this->threshold = threshold;
+	this->output = output;
+	this->out = out;
+	kernels = &getBestClassifyKernels();
+	origin = 0;
+	rows = 0;
+	cells = 0;
+	segments = 0;
+
+	samples.resize(getRowBytes());
+	upper.resize(width);
+	lower.resize(width);
+	states.resize(width > 1 ? width - 1 : 0);
+	buildCaseSegments(caseSegments);
+}
+
+// Takes the next raster row, width samples of the raster's type, and writes out the squares above it
+void ScanlineContour::addRow(const void *row) {
+	// Last row's vertices become the top of this row's squares
+	upper.swap(lower);
+	convertRow(row, lower);
+
+	if (rows > 0) {
+		classifyRows(upper.data(), lower.data());
+	}
+
+	rows++;
+}
+
+// Contours every whole row left in input, returning how many were read
+long long ScanlineContour::streamFile(FILE *input) {
+	long long first = rows;
+	size_t rowBytes = getRowBytes();
+
+	while (fread(samples.data(), 1, rowBytes, input) == rowBytes) {
+		addRow(samples.data());
+	}
+
+	return rows - first;
+}
+
+// Contours rows first to last of a raster on their own, numbering squares by
+// raster row. Aligned float32 rows are classified where they're mapped, other
+// rows are converted one at a time like addRow does.
+long long ScanlineContour::streamRaster(MappedRaster &raster, long long first, long long last) {
+	bool inPlace = type == RASTER_FLOAT32 && raster.isAligned();
+	long long ahead = (long long)(READAHEAD_BYTES / getRowBytes());
+	long long advised = first - 1;
+	const float *previous = NULL;
+
+	origin = first;
+	rows = 0;
+
+	for (long long r = first; r <= last; r++) {
+		// Keeping the next stretch of rows on its way in while this one is contoured
+		if (r > advised) {
+			advised = r + (ahead > 0 ? ahead : 1) - 1;
+			advised = advised < last ? advised : last;
+			raster.adviseRows(r, advised);
+		}
+
+		const void *row = raster.getRow(r);
+
+		if (!inPlace) {
+			addRow(row);
+			continue;
+		}
+
+		const float *current = static_cast<const float*>(row);
+
+		if (rows > 0) {
+			classifyRows(previous, current);
+		}
+
+		previous = current;
+		rows++;
+	}
+
+	return rows;
+}
+
+void ScanlineContour::convertRow(const void *row, std::vector<float> &vertices) {
+	if (type == RASTER_FLOAT32) {
+		memcpy(vertices.data(), row, width * sizeof(float));
+		return;
+	}
+
+	const unsigned char *bytes = static_cast<const unsigned char*>(row);
+
+	for (int j = 0; j < width; j++) {
+		vertices[j] = bytes[j];
+	}
+}
+
+// Writes out the row of squares between two vertex rows
+void ScanlineContour::classifyRows(const float *top, const float *bottom) {
+	if (width > 1) {
+		kernels->classifyRow(top, bottom, states.data(), width - 1, threshold);
+		emitRow(origin + rows - 1);
+	}
+}
+
+void ScanlineContour::emitRow(long long row) {
+	int count = width - 1;
+	const unsigned char *rowStates = states.data();
+
+	for (int j = 0; j < count; j++) {
+		// Skipping eight empty squares at a time
+		unsigned long long chunk;
+		if (j + 8 <= count) {
+			memcpy(&chunk, rowStates + j, sizeof(chunk));
+			if (chunk == 0) {
+				j += 7;
+				continue;
+			}
+		}
+
+		int state = rowStates[j];
+
+		if (state == EMPTY) {
+			continue;
+		}
+
+		const std::vector<float> &lines = caseSegments[state];
+		cells++;
+		segments += lines.size() / 4;
+
+		if (output == CONTOUR_CELLS) {
+			fprintf(out, "%lld %d %d\n", row, j, state);
+			continue;
+		} else if (output != CONTOUR_SEGMENTS) {
+			continue;
+		}
+
+		// Templates span -1 to 1 with y up, samples run one apart with y down
+		for (unsigned int s = 0; s < lines.size(); s += 4) {
+			fprintf(out, "%g %g %g %g\n", j + (lines[s] + 1.0f) * 0.5f, row + (1.0f - lines[s + 1]) * 0.5f,
+				j + (lines[s + 2] + 1.0f) * 0.5f, row + (1.0f - lines[s + 3]) * 0.5f);
+		}
+	}
+}
+
+// Uses the fastest case kernel up to level that this CPU supports
+void ScanlineContour::setKernelLevel(KernelLevel level) {
+	kernels = &getClassifyKernels(level);
+}
+
+const ClassifyKernels& ScanlineContour::getKernels() {
+	return *kernels;
+}
+
+size_t ScanlineContour::getRowBytes() {
+	return width * rasterSampleBytes(type);
+}
+
+long long ScanlineContour::getRows() {
+	return rows;
+}
+
+long long ScanlineContour::getCells() {
+	return cells;
+}
+
+long long ScanlineContour::getSegments() {
+	return segments;
+}
+
+// Bytes held for rows, which stays the same however many rows go through
+size_t ScanlineContour::getBytes() {
+	return samples.capacity() + (upper.capacity() + lower.capacity()) * sizeof(float) + states.capacity();
+}
+
+size_t rasterSampleBytes(RasterType type) {
+	return type == RASTER_FLOAT32 ? sizeof(float) : 1;
+}
+
+// Maps the command line names uint8 and float32 onto raster types
+bool parseRasterType(const char *name, RasterType &type) {
+	if (strcmp(name, "uint8") == 0) {
+		type = RASTER_UINT8;
+	} else if (strcmp(name, "float32") == 0) {
+		type = RASTER_FLOAT32;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+// Maps the command line names cells, segments and none onto outputs
+bool parseContourOutput(const char *name, ContourOutput &output) {
+	const char *names[] = { "cells", "segments", "none" };
+
+	for (int i = 0; i < 3; i++) {
+		if (strcmp(name, names[i]) == 0) {
+			output = static_cast<ContourOutput>(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// A case's outline is every triangle edge used once that doesn't run along the square's border
+void buildCaseSegments(std::vector<float> segments[CASE_COUNT]) {
+	for (int c = 0; c < CASE_COUNT; c++) {
+		const CasePoint *verts = &CASE_POINTS[CASE_OFFSETS.first[c]];
+		std::vector<float> edges;
+
+		segments[c].clear();
+
+		for (int t = 0; t < CASE_VERTEX_COUNTS[c]; t += 3) {
+			for (int e = 0; e < 3; e++) {
+				const CasePoint &a = verts[t + e];
+				const CasePoint &b = verts[t + (e + 1) % 3];
+				edges.insert(edges.end(), { a.x, a.y, b.x, b.y });
+			}
+		}
+
+		for (unsigned int e = 0; e < edges.size(); e += 4) {
+			const float *edge = &edges[e];
+			bool border = (edge[0] == edge[2] && (edge[0] == -1.0f || edge[0] == 1.0f))
+				|| (edge[1] == edge[3] && (edge[1] == -1.0f || edge[1] == 1.0f));
+			int uses = 0;
+
+			// Shared edges run between two triangles of the same case, in either direction
+			for (unsigned int o = 0; o < edges.size(); o += 4) {
+				const float *other = &edges[o];
+
+				if ((other[0] == edge[0] && other[1] == edge[1] && other[2] == edge[2] && other[3] == edge[3])
+					|| (other[0] == edge[2] && other[1] == edge[3] && other[2] == edge[0] && other[3] == edge[1])) {
+					uses++;
+				}
+			}
+
+			if (!border && uses == 1) {
+				segments[c].insert(segments[c].end(), edge, edge + 4);
+			}
+		}
+	}
+}
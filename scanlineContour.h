@@ -0,0 +1,87 @@
+/*
+	Marching Squares - Scanline Contour
+	Contours a raster of samples one row at a time, keeping only the two
+	vertex rows a row of squares needs, so memory follows the width alone.
+	Every sample is a grid vertex, and squares sit between four of them.
+*/
+
+#ifndef SCANLINE_CONTOUR_H
+#define SCANLINE_CONTOUR_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <vector>
+
+#include "caseTable.h"
+#include "classifyKernels.h"
+
+// Bytes of a mapped raster asked for ahead of the row being contoured
+const size_t READAHEAD_BYTES = 32 << 20;
+
+typedef enum RasterType {
+	RASTER_UINT8,
+	RASTER_FLOAT32
+} RasterType;
+
+typedef enum ContourOutput {
+	// "row col case" per non-empty square
+	CONTOUR_CELLS,
+	// "x0 y0 x1 y1" per outline segment, in samples with y growing down the raster
+	CONTOUR_SEGMENTS,
+	// Counting only
+	CONTOUR_NONE
+} ContourOutput;
+
+class MappedRaster;
+
+// Rows go in through addRow, straight from a file through streamFile, or in
+// place from a mapped raster through streamRaster, and each row of squares is
+// written out as soon as the row below it arrives.
+// Cases come from the classification kernels and outlines from the
+// CASE_POINTS templates, so they match what the engine draws.
+class ScanlineContour {
+	private:
+		int width;
+		RasterType type;
+		float threshold;
+		ContourOutput output;
+		FILE *out;
+		const ClassifyKernels *kernels;
+
+		std::vector<unsigned char> samples;
+		std::vector<float> upper;
+		std::vector<float> lower;
+		std::vector<unsigned char> states;
+		// Outline segments of each case as x0, y0, x1, y1 in template space
+		std::vector<float> caseSegments[CASE_COUNT];
+
+		// Raster row of the first row taken
+		long long origin;
+		long long rows;
+		long long cells;
+		long long segments;
+
+		void convertRow(const void *row, std::vector<float> &vertices);
+		void classifyRows(const float *top, const float *bottom);
+		void emitRow(long long row);
+
+	public:
+		ScanlineContour(int width, RasterType type, float threshold, ContourOutput output, FILE *out);
+		void addRow(const void *row);
+		long long streamFile(FILE *input);
+		long long streamRaster(MappedRaster &raster, long long first, long long last);
+		void setKernelLevel(KernelLevel level);
+		const ClassifyKernels& getKernels();
+		size_t getRowBytes();
+		long long getRows();
+		long long getCells();
+		long long getSegments();
+		size_t getBytes();
+};
+
+size_t rasterSampleBytes(RasterType type);
+bool parseRasterType(const char *name, RasterType &type);
+bool parseContourOutput(const char *name, ContourOutput &output);
+void buildCaseSegments(std::vector<float> segments[CASE_COUNT]);
+
+#endif
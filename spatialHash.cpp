@@ -0,0 +1,102 @@
+/*
+	Marching Squares - Spatial Hash
+	Uniform buckets of squares listing the balls that reach each one,
+	rebuilt from scratch every frame after the balls have moved.
+*/
+
+#include "spatialHash.h"
+
+//////////////////////
+// class: SpatialHash
+//////////////////
+
+SpatialHash::SpatialHash() {
+	bucketSize = 1;
+	bucketRows = 0;
+	bucketCols = 0;
+}
+
+// Covers a rows by cols grid of squares with bucketSize square buckets
+void SpatialHash::resize(int rows, int cols, int bucketSize) {
+	this->bucketSize = bucketSize;
+	bucketRows = (rows + bucketSize - 1) / bucketSize;
+	bucketCols = (cols + bucketSize - 1) / bucketSize;
+
+	starts.assign(bucketRows * bucketCols + 1, 0);
+	cursors.assign(bucketRows * bucketCols, 0);
+	entries.clear();
+	occupied.clear();
+}
+
+// Lists ball b in every bucket reaches[b] overlaps, reaches must already be clamped to the grid
+void SpatialHash::build(const std::vector<GridWindow> &reaches) {
+	int bucketCount = bucketRows * bucketCols;
+
+	starts.assign(bucketCount + 1, 0);
+
+	// Counting each bucket's balls one slot ahead, so the prefix sum leaves the starts
+	for (unsigned int b = 0; b < reaches.size(); b++) {
+		const GridWindow &reach = reaches[b];
+
+		if (reach.top > reach.bottom || reach.left > reach.right) {
+			continue;
+		}
+
+		for (int r = reach.top / bucketSize; r <= reach.bottom / bucketSize; r++) {
+			for (int c = reach.left / bucketSize; c <= reach.right / bucketSize; c++) {
+				starts[r * bucketCols + c + 1]++;
+			}
+		}
+	}
+
+	occupied.clear();
+
+	for (int i = 0; i < bucketCount; i++) {
+		if (starts[i + 1] != 0) {
+			occupied.push_back(i);
+		}
+
+		starts[i + 1] += starts[i];
+		cursors[i] = starts[i];
+	}
+
+	entries.resize(starts[bucketCount]);
+
+	// Filling in ball order keeps every bucket sorted
+	for (unsigned int b = 0; b < reaches.size(); b++) {
+		const GridWindow &reach = reaches[b];
+
+		if (reach.top > reach.bottom || reach.left > reach.right) {
+			continue;
+		}
+
+		for (int r = reach.top / bucketSize; r <= reach.bottom / bucketSize; r++) {
+			for (int c = reach.left / bucketSize; c <= reach.right / bucketSize; c++) {
+				entries[cursors[r * bucketCols + c]++] = b;
+			}
+		}
+	}
+}
+
+// Balls reaching bucket, in ball order
+const unsigned int* SpatialHash::getBalls(int bucket, unsigned int &count) {
+	count = starts[bucket + 1] - starts[bucket];
+	return count == 0 ? NULL : &entries[starts[bucket]];
+}
+
+const std::vector<int>& SpatialHash::getOccupied() {
+	return occupied;
+}
+
+int SpatialHash::getBucketRows() {
+	return bucketRows;
+}
+
+int SpatialHash::getBucketCols() {
+	return bucketCols;
+}
+
+size_t SpatialHash::getBytes() {
+	return (starts.capacity() + entries.capacity() + cursors.capacity()) * sizeof(unsigned int)
+		+ occupied.capacity() * sizeof(int);
+}
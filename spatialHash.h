@@ -0,0 +1,43 @@
+/*
+	Marching Squares - Spatial Hash
+	Uniform buckets of squares listing the balls that reach each one,
+	rebuilt from scratch every frame after the balls have moved.
+*/
+
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "dirtyRegion.h"
+
+// The grid is bounded, so a bucket's index is just its row and column and
+// nothing ever collides. A ball is listed in every bucket its window of
+// squares overlaps, and each bucket lists its balls in ball order. Counting
+// twice lets all buckets share one array, so a rebuild allocates nothing
+// once the storage has grown.
+class SpatialHash {
+	private:
+		int bucketSize;
+		int bucketRows;
+		int bucketCols;
+		// Bucket b's balls are entries[starts[b]] up to entries[starts[b + 1]]
+		std::vector<unsigned int> starts;
+		std::vector<unsigned int> entries;
+		std::vector<unsigned int> cursors;
+		// Buckets holding at least one ball, in bucket order
+		std::vector<int> occupied;
+
+	public:
+		SpatialHash();
+		void resize(int rows, int cols, int bucketSize);
+		void build(const std::vector<GridWindow> &reaches);
+		const unsigned int* getBalls(int bucket, unsigned int &count);
+		const std::vector<int>& getOccupied();
+		int getBucketRows();
+		int getBucketCols();
+		size_t getBytes();
+};
+
+#endif
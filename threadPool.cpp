@@ -0,0 +1,178 @@
+/*
+	Marching Squares - Thread Pool
+	Fixed set of worker threads running indexed tasks, with each worker
+	stealing from the others once its own queue runs dry.
+*/
+
+#include "threadPool.h"
+#include "tracer.h"
+
+/////////////////////
+// class: ThreadPool
+/////////////////
+
+ThreadPool::ThreadPool(unsigned int threadCount) {
+	if (threadCount == 0) {
+		threadCount = std::thread::hardware_concurrency();
+	}
+
+	if (threadCount == 0) {
+		threadCount = 1;
+	}
+
+	job = NULL;
+	jobGeneration = 0;
+	remaining = 0;
+	busy = 0;
+	stopping = false;
+
+	for (unsigned int i = 0; i < threadCount; i++) {
+		queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+	}
+
+	// Worker 0 is whichever thread calls parallelFor
+	for (unsigned int i = 1; i < threadCount; i++) {
+		threads.push_back(std::thread(&ThreadPool::workerLoop, this, (int)i));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> guard(jobLock);
+		stopping = true;
+	}
+
+	jobReady.notify_all();
+
+	for (unsigned int i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+}
+
+// Runs body(0) through body(count - 1) across the pool, returning once all have finished
+void ThreadPool::parallelFor(int count, const std::function<void(int)> &body) {
+	if (count <= 0) {
+		return;
+	}
+
+	int workers = (int)queues.size();
+
+	if (workers == 1 || count == 1) {
+		for (int i = 0; i < count; i++) {
+			body(i);
+		}
+		return;
+	}
+
+	// Neighbouring tasks stay on one worker until someone steals them
+	for (int w = 0; w < workers; w++) {
+		std::lock_guard<std::mutex> guard(queues[w]->lock);
+		int first = (int)((long long)count * w / workers);
+		int last = (int)((long long)count * (w + 1) / workers);
+
+		for (int i = first; i < last; i++) {
+			queues[w]->tasks.push_back(i);
+		}
+	}
+
+	// Published together, so a worker waking late for the last job can't pair its generation with this count
+	{
+		std::lock_guard<std::mutex> guard(jobLock);
+		remaining = count;
+		job = &body;
+		jobGeneration++;
+	}
+
+	jobReady.notify_all();
+	runTasks(0, body);
+
+	// No worker may still be looking at this job's queues when the next one fills them
+	std::unique_lock<std::mutex> lock(jobLock);
+	jobDone.wait(lock, [this] { return remaining == 0 && busy == 0; });
+	job = NULL;
+}
+
+unsigned int ThreadPool::getThreadCount() {
+	return (unsigned int)queues.size();
+}
+
+void ThreadPool::workerLoop(int worker) {
+	unsigned long seen = 0;
+
+	nameTraceThread("pool worker", worker);
+
+	while (true) {
+		const std::function<void(int)> *body;
+
+		{
+			std::unique_lock<std::mutex> lock(jobLock);
+			jobReady.wait(lock, [this, &seen] { return stopping || jobGeneration != seen; });
+
+			if (stopping) {
+				return;
+			}
+
+			seen = jobGeneration;
+
+			// Waking after the job already finished, there is nothing left to take
+			if (remaining == 0 || job == NULL) {
+				continue;
+			}
+
+			body = job;
+			busy++;
+		}
+
+		runTasks(worker, *body);
+
+		{
+			std::lock_guard<std::mutex> guard(jobLock);
+			busy--;
+		}
+
+		jobDone.notify_all();
+	}
+}
+
+void ThreadPool::runTasks(int worker, const std::function<void(int)> &body) {
+	int task;
+
+	while (takeTask(worker, task)) {
+		body(task);
+
+		if (--remaining == 0) {
+			// Taking the lock so the notify can't slip in before parallelFor waits
+			std::lock_guard<std::mutex> guard(jobLock);
+			jobDone.notify_all();
+		}
+	}
+}
+
+// Pops from the front of the worker's own queue, then steals from the back of the others
+bool ThreadPool::takeTask(int worker, int &task) {
+	{
+		WorkQueue &own = *queues[worker];
+		std::lock_guard<std::mutex> guard(own.lock);
+
+		if (!own.tasks.empty()) {
+			task = own.tasks.front();
+			own.tasks.pop_front();
+			return true;
+		}
+	}
+
+	int workers = (int)queues.size();
+
+	for (int i = 1; i < workers; i++) {
+		WorkQueue &victim = *queues[(worker + i) % workers];
+		std::lock_guard<std::mutex> guard(victim.lock);
+
+		if (!victim.tasks.empty()) {
+			task = victim.tasks.back();
+			victim.tasks.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,52 @@
+/*
+	Marching Squares - Thread Pool
+	Fixed set of worker threads running indexed tasks, with each worker
+	stealing from the others once its own queue runs dry.
+*/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// parallelFor hands each worker a contiguous block of task indices. Owners
+// take tasks from the front of their block, idle workers steal from the back
+// of someone else's. The calling thread works as worker 0.
+class ThreadPool {
+	private:
+		typedef struct WorkQueue {
+			std::mutex lock;
+			std::deque<int> tasks;
+		} WorkQueue;
+
+		std::vector<std::thread> threads;
+		std::vector<std::unique_ptr<WorkQueue> > queues;
+		std::mutex jobLock;
+		std::condition_variable jobReady;
+		std::condition_variable jobDone;
+		const std::function<void(int)> *job;
+		unsigned long jobGeneration;
+		std::atomic<int> remaining;
+		int busy;
+		bool stopping;
+
+		void workerLoop(int worker);
+		void runTasks(int worker, const std::function<void(int)> &body);
+		bool takeTask(int worker, int &task);
+
+	public:
+		// Zero sizes the pool to the machine
+		ThreadPool(unsigned int threadCount = 0);
+		~ThreadPool();
+		void parallelFor(int count, const std::function<void(int)> &body);
+		unsigned int getThreadCount();
+};
+
+#endif
@@ -0,0 +1,65 @@
+/*
+	Marching Squares - Thread Pool Test
+	Runs many small parallelFor calls back to back, the pattern runTiles
+	produces every frame, checking every task runs exactly once each time.
+	Exits with 1 on the first call that loses or repeats a task.
+
+	Usage: threadPoolTest [--calls N] [--threads N]
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+
+#include "threadPool.h"
+
+const int DEFAULT_CALLS = 200000;
+const unsigned int DEFAULT_THREADS = 8;
+// Task counts cycled through, small ones finish before late workers wake
+const int TASK_COUNTS[] = { 3, 2, 7, 3, 64, 3 };
+const int TASK_COUNT_KINDS = sizeof(TASK_COUNTS) / sizeof(TASK_COUNTS[0]);
+const int MAX_TASKS = 64;
+
+int main(int argc, char *argv[]) {
+	int calls = DEFAULT_CALLS;
+	unsigned int threads = DEFAULT_THREADS;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--calls") == 0 && i + 1 < argc) {
+			calls = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = static_cast<unsigned int>(strtoul(argv[++i], NULL, 10));
+		} else {
+			fprintf(stderr, "Usage: %s [--calls N] [--threads N]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	ThreadPool pool(threads);
+	std::vector<std::atomic<int> > runs(MAX_TASKS);
+
+	for (int call = 0; call < calls; call++) {
+		int count = TASK_COUNTS[call % TASK_COUNT_KINDS];
+
+		for (int t = 0; t < count; t++) {
+			runs[t].store(0, std::memory_order_relaxed);
+		}
+
+		pool.parallelFor(count, [&runs](int task) {
+			runs[task].fetch_add(1, std::memory_order_relaxed);
+		});
+
+		for (int t = 0; t < count; t++) {
+			if (runs[t].load(std::memory_order_relaxed) != 1) {
+				printf("call %d: task %d of %d ran %d times\n", call, t, count, runs[t].load());
+				return 1;
+			}
+		}
+	}
+
+	printf("threads: %u, calls: %d, every task ran once\n", pool.getThreadCount(), calls);
+
+	return 0;
+}
@@ -0,0 +1,221 @@
+/*
+	Marching Squares - Tracer
+	Scoped timeline events kept per thread in lock-free rings, written out
+	as Chrome trace-event JSON for chrome://tracing or Perfetto.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "tracer.h"
+
+const int TRACE_NAME_BYTES = 32;
+
+// Fields are relaxed atomics so a ring can be read while its thread writes,
+// plain stores and loads on the machines this runs on
+typedef struct TraceEvent {
+	std::atomic<const char*> name;
+	std::atomic<long long> start;
+	std::atomic<long long> duration;
+	std::atomic<long long> arg;
+} TraceEvent;
+
+// Written only by its own thread. head counts every event ever recorded, the
+// event numbered n sits at n modulo the capacity.
+typedef struct TraceRing {
+	std::unique_ptr<TraceEvent[]> events;
+	std::atomic<unsigned long long> head;
+	// Guarded by registryLock
+	char name[TRACE_NAME_BYTES];
+	int id;
+} TraceRing;
+
+// A ring entry copied out for writing
+typedef struct TraceRecord {
+	const char *name;
+	long long start;
+	long long duration;
+	long long arg;
+} TraceRecord;
+
+std::atomic<bool> tracingEnabled(false);
+
+// Rings are kept until exit, so threads that have finished still show up
+static std::mutex registryLock;
+static std::vector<std::unique_ptr<TraceRing> > rings;
+// Trace clock and steady clock readings taken together at the last start
+static std::atomic<long long> traceEpoch(0);
+static std::atomic<long long> epochNs(0);
+static thread_local TraceRing *threadRing = NULL;
+static thread_local char threadName[TRACE_NAME_BYTES] = "";
+
+static long long steadyNs();
+static TraceRing* addRing();
+static void copyRing(TraceRing &ring, long long epoch, std::vector<TraceRecord> &records);
+
+// Events from before the last start are left out when writing
+void startTracing() {
+	traceEpoch.store(traceClock(), std::memory_order_relaxed);
+	epochNs.store(steadyNs(), std::memory_order_relaxed);
+	tracingEnabled.store(true, std::memory_order_release);
+}
+
+void stopTracing() {
+	tracingEnabled.store(false, std::memory_order_release);
+}
+
+static long long steadyNs() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Records an event on the calling thread ending now, giving the thread a ring the first time
+void recordTraceEvent(const char *name, long long start, long long arg) {
+	long long end = traceClock();
+	TraceRing *ring = threadRing;
+
+	if (ring == NULL) {
+		ring = threadRing = addRing();
+	}
+
+	unsigned long long head = ring->head.load(std::memory_order_relaxed);
+	TraceEvent &event = ring->events[head & (TRACE_EVENTS_PER_THREAD - 1)];
+
+	event.name.store(name, std::memory_order_relaxed);
+	event.start.store(start, std::memory_order_relaxed);
+	event.duration.store(end - start, std::memory_order_relaxed);
+	event.arg.store(arg, std::memory_order_relaxed);
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+// Names the calling thread in traces, followed by index unless it is negative
+void nameTraceThread(const char *name, int index) {
+	if (index >= 0) {
+		snprintf(threadName, sizeof(threadName), "%s %d", name, index);
+	} else {
+		snprintf(threadName, sizeof(threadName), "%s", name);
+	}
+
+	if (threadRing != NULL) {
+		std::lock_guard<std::mutex> guard(registryLock);
+		memcpy(threadRing->name, threadName, sizeof(threadName));
+	}
+}
+
+static TraceRing* addRing() {
+	std::unique_ptr<TraceRing> ring(new TraceRing());
+	ring->events.reset(new TraceEvent[TRACE_EVENTS_PER_THREAD]());
+	ring->head.store(0, std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> guard(registryLock);
+	ring->id = (int)rings.size() + 1;
+	memcpy(ring->name, threadName, sizeof(threadName));
+
+	if (ring->name[0] == '\0') {
+		snprintf(ring->name, sizeof(ring->name), "thread %d", ring->id);
+	}
+
+	rings.push_back(std::move(ring));
+
+	return rings.back().get();
+}
+
+// Copies the events still in the ring, dropping any its thread overwrote
+// while they were being copied
+static void copyRing(TraceRing &ring, long long epoch, std::vector<TraceRecord> &records) {
+	unsigned long long end = ring.head.load(std::memory_order_acquire);
+	unsigned long long first = end > TRACE_EVENTS_PER_THREAD ? end - TRACE_EVENTS_PER_THREAD : 0;
+	size_t copied = records.size();
+
+	for (unsigned long long n = first; n < end; n++) {
+		TraceEvent &event = ring.events[n & (TRACE_EVENTS_PER_THREAD - 1)];
+		records.push_back(TraceRecord{ event.name.load(std::memory_order_relaxed), event.start.load(std::memory_order_relaxed),
+			event.duration.load(std::memory_order_relaxed), event.arg.load(std::memory_order_relaxed) });
+	}
+
+	// The writer may be filling the slot of event head, which held event head - capacity
+	std::atomic_thread_fence(std::memory_order_acquire);
+	unsigned long long after = ring.head.load(std::memory_order_relaxed);
+	unsigned long long kept = after + 1 > TRACE_EVENTS_PER_THREAD ? after + 1 - TRACE_EVENTS_PER_THREAD : 0;
+	size_t stale = kept > first ? (size_t)(kept - first) : 0;
+	stale = stale < records.size() - copied ? stale : records.size() - copied;
+
+	records.erase(records.begin() + copied, records.begin() + copied + stale);
+
+	// Events recorded before the last start belong to an earlier trace
+	size_t to = copied;
+	for (size_t i = copied; i < records.size(); i++) {
+		if (records[i].start >= epoch) {
+			records[to++] = records[i];
+		}
+	}
+
+	records.resize(to);
+}
+
+// Writes every thread's events as complete ("X") events in microseconds from
+// the last start, safe to call while threads are still recording. The time
+// stamp counter is taken to tick at a constant rate, as it does on current x86.
+bool writeTrace(const char *path) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+
+	long long epoch = traceEpoch.load(std::memory_order_relaxed);
+	long long elapsedTicks = traceClock() - epoch;
+	long long elapsedNs = steadyNs() - epochNs.load(std::memory_order_relaxed);
+	// Microseconds per trace clock tick, measured over the whole trace
+	double tickUs = elapsedTicks > 0 && elapsedNs > 0 ? elapsedNs / 1000.0 / elapsedTicks : 0.001;
+	std::vector<TraceRing*> snapshot;
+	std::vector<TraceRecord> records;
+	char name[TRACE_NAME_BYTES];
+
+	{
+		std::lock_guard<std::mutex> guard(registryLock);
+
+		for (unsigned int r = 0; r < rings.size(); r++) {
+			snapshot.push_back(rings[r].get());
+		}
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Marching Squares\"}}");
+
+	for (unsigned int r = 0; r < snapshot.size(); r++) {
+		TraceRing &ring = *snapshot[r];
+
+		{
+			std::lock_guard<std::mutex> guard(registryLock);
+			memcpy(name, ring.name, sizeof(name));
+		}
+
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", ring.id, name);
+
+		records.clear();
+		copyRing(ring, epoch, records);
+
+		for (unsigned int i = 0; i < records.size(); i++) {
+			const TraceRecord &record = records[i];
+
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", record.name, ring.id,
+				(record.start - epoch) * tickUs, record.duration * tickUs);
+
+			if (record.arg != TRACE_NO_ARG) {
+				fprintf(file, ",\"args\":{\"index\":%lld}", record.arg);
+			}
+
+			fprintf(file, "}");
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+
+	bool written = ferror(file) == 0;
+	written = fclose(file) == 0 && written;
+
+	return written;
+}
@@ -0,0 +1,73 @@
+/*
+	Marching Squares - Tracer
+	Scoped timeline events kept per thread in lock-free rings, written out
+	as Chrome trace-event JSON for chrome://tracing or Perfetto.
+*/
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+	#define TRACE_CLOCK_TSC 1
+	#include <x86intrin.h>
+#else
+	#define TRACE_CLOCK_TSC 0
+#endif
+
+// Events each thread keeps, older ones are overwritten. A power of two.
+const size_t TRACE_EVENTS_PER_THREAD = 1 << 17;
+
+// Marks an event without an argument
+const long long TRACE_NO_ARG = -1;
+
+extern std::atomic<bool> tracingEnabled;
+
+void startTracing();
+void stopTracing();
+void recordTraceEvent(const char *name, long long start, long long arg);
+void nameTraceThread(const char *name, int index = -1);
+bool writeTrace(const char *path);
+
+inline bool isTracing() {
+	return tracingEnabled.load(std::memory_order_relaxed);
+}
+
+// Ticks of the time stamp counter where there is one, a few times cheaper to
+// read than the steady clock, and steady clock nanoseconds elsewhere. Ticks
+// are turned into time against the steady clock when the trace is written.
+inline long long traceClock() {
+#if TRACE_CLOCK_TSC
+	return (long long)__rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Records one complete event from construction to destruction on the calling
+// thread. A scope is one record rather than a begin and an end, so a ring that
+// has wrapped never holds half a scope. Names must outlive the tracer, string
+// literals in practice, and are written out unescaped. With tracing off a
+// scope costs one relaxed load.
+class TraceScope {
+	private:
+		const char *name;
+		long long arg;
+		long long start;
+
+	public:
+		TraceScope(const char *name, long long arg = TRACE_NO_ARG) : name(name), arg(arg) {
+			start = isTracing() ? traceClock() : -1;
+		}
+
+		~TraceScope() {
+			if (start >= 0) {
+				recordTraceEvent(name, start, arg);
+			}
+		}
+};
+
+#endif
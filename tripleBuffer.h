@@ -0,0 +1,60 @@
+/*
+	Marching Squares - Triple Buffer
+	Three slots passed between one writer thread and one reader thread, so
+	the reader always finds the latest finished frame without either side
+	waiting on the other.
+*/
+
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// The writer fills the back slot and publishes it by swapping it with the
+// middle one, the reader takes the middle slot by swapping it with the front
+// one. Only the middle index is shared, packed with a bit saying it holds a
+// frame the reader hasn't taken yet. Frames published faster than they're
+// read are overwritten, slots keep their storage between frames.
+template<typename T>
+class TripleBuffer {
+	private:
+		static const unsigned int INDEX_MASK = 3;
+		static const unsigned int FRESH_BIT = 4;
+
+		T slots[3];
+		std::atomic<unsigned int> middle;
+		// Owned by the writer and reader respectively
+		unsigned int back;
+		unsigned int front;
+
+	public:
+		TripleBuffer() : middle(1), back(0), front(2) {}
+
+		// Writer side, the slot to fill next
+		T& getBack() {
+			return slots[back];
+		}
+
+		// Writer side, hands the back slot to the reader and takes over the middle one
+		void publish() {
+			back = middle.exchange(back | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+		}
+
+		// Reader side, moves the latest published frame to the front, false if nothing new was published
+		bool acquire() {
+			if ((middle.load(std::memory_order_relaxed) & FRESH_BIT) == 0) {
+				return false;
+			}
+
+			front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+
+			return true;
+		}
+
+		// Reader side, the frame last acquired
+		T& getFront() {
+			return slots[front];
+		}
+};
+
+#endif